@@ -1,30 +1,133 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/main.h"
 
+// parse a byte count like 32768, 48K or 2M — returns -1 if malformed
+static long parse_size(const char *s) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || v < 0) return -1;
+    if      (*end == 'K' || *end == 'k') { v *= 1024;        end++; }
+    else if (*end == 'M' || *end == 'm') { v *= 1024 * 1024; end++; }
+    return *end ? -1 : v;
+}
+
+// --flag or --flag=value — returns 0 if the flag is unknown or malformed
+static int parse_option(const char *arg) {
+    if (strncmp(arg, "--l1-cache=", 11) == 0)
+        return (options.l1_cache = parse_size(arg + 11)) > 0;
+    if (strncmp(arg, "--l2-cache=", 11) == 0)
+        return (options.l2_cache = parse_size(arg + 11)) > 0;
+    if (strncmp(arg, "--tile-size=", 12) == 0)
+        return (options.tile_size = atoi(arg + 12)) > 0;
+    if (strcmp(arg, "--prefetch") == 0) {
+        options.prefetch = 64;
+        return 1;
+    }
+    if (strncmp(arg, "--prefetch=", 11) == 0)
+        return (options.prefetch = atoi(arg + 11)) > 0;
+    if (strcmp(arg, "--no-tile") == 0) {
+        options.tile_size = -1;
+        return 1;
+    }
+    if (strcmp(arg, "--profile-generate") == 0) {
+        options.profile_generate = "k.profile";
+        return 1;
+    }
+    if (strncmp(arg, "--profile-generate=", 19) == 0)
+        return *(options.profile_generate = arg + 19) != 0;
+    if (strcmp(arg, "--profile-use") == 0) {
+        options.profile_use = "k.profile";
+        return 1;
+    }
+    if (strncmp(arg, "--profile-use=", 14) == 0)
+        return *(options.profile_use = arg + 14) != 0;
+    if (strcmp(arg, "--instrument") == 0) {
+        options.instrument = "";
+        return 1;
+    }
+    if (strncmp(arg, "--instrument=", 13) == 0)
+        return *(options.instrument = arg + 13) != 0;
+    if (strcmp(arg, "--trace-alloc") == 0) {
+        options.trace_alloc = "";
+        return 1;
+    }
+    if (strncmp(arg, "--trace-alloc=", 14) == 0)
+        return *(options.trace_alloc = arg + 14) != 0;
+    if (strcmp(arg, "--remarks") == 0) {
+        options.remarks = "";
+        return 1;
+    }
+    if (strncmp(arg, "--remarks=", 10) == 0)
+        return *(options.remarks = arg + 10) != 0;
+    if (strcmp(arg, "--remarks-format=json") == 0) {
+        options.remarks_json = 1;
+        return 1;
+    }
+    if (strcmp(arg, "--remarks-format=text") == 0) {
+        options.remarks_json = 0;
+        return 1;
+    }
+    if (strcmp(arg, "--write-thread") == 0) {
+        options.write_thread = 1;
+        return 1;
+    }
+    if (strcmp(arg, "-g") == 0 || strcmp(arg, "--debug") == 0) {
+        options.debug = 1;
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     const char *input_file = "src/main.k";
-    if (argc > 1) input_file = argv[1];
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            input_file = argv[i];
+            continue;
+        }
+        if (!parse_option(argv[i])) {
+            fprintf(stderr, "Unknown or malformed option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
 
-    // read source file
-    FILE *f = fopen(input_file, "r");
-    if (!f) {
+    // map the source read-only — the lexer reads it in place and tokens
+    // point into it, so nothing is copied and pages load as they're touched
+    int fd = open(input_file, O_RDONLY);
+    if (fd < 0) {
         perror("Failed to open input file");
         return 1;
     }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Failed to stat input file");
+        return 1;
+    }
+    long len = st.st_size;
+    const char *src = "";               // mmap refuses an empty file
+    if (len > 0) {
+        src = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (src == MAP_FAILED) {
+            perror("Failed to map input file");
+            return 1;
+        }
+        madvise((void *)src, len, MADV_SEQUENTIAL);
+    }
+    close(fd);
 
-    fseek(f, 0, SEEK_END);
-    long len = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    char *src = malloc(len + 1);
-    fread(src, 1, len, f);
-    src[len] = 0;
-    fclose(f);
+    // line info names the source by absolute path so perf / gdb can find it
+    char src_path[4096];
+    options.source_path = realpath(input_file, src_path) ? src_path : input_file;
 
     // pipeline
     printf("[1] Tokenizing...\n");
-    tokenize(src);
+    tokenize(src, len);
 
     printf("[2] Parsing...\n");
     Node *ast = parse();
@@ -33,7 +136,8 @@ int main(int argc, char **argv) {
     generate(ast, "output.s");
 
     printf("[4] Assembling...\n");
-    system("nasm -f elf64 output.s -o output.o");
+    if (options.debug) system("nasm -f elf64 -g -F dwarf output.s -o output.o");
+    else               system("nasm -f elf64 output.s -o output.o");
 
     printf("[5] Linking...\n");
     system("gcc -no-pie output.o -o output_exe");
@@ -43,6 +147,6 @@ int main(int argc, char **argv) {
     system("./output_exe");
     printf("─────────────────\n");
 
-    free(src);
+    if (len > 0) munmap((void *)src, len);
     return 0;
 }
@@ -13,7 +13,7 @@ gcc -c -o build/codegen.o src/codegen.c -Iinclude
 gcc -c -o build/runner.o bin/runner.c -Iinclude
 
 echo "[3/3] Linking..."
-gcc -no-pie -o build/k_runner \
+gcc -no-pie -pthread -o build/k_runner \
   build/runner.o \
   build/lexer.o \
   build/parser.o \
@@ -7,6 +7,7 @@
 typedef enum {
     // literals
     TOK_NUMBER,
+    TOK_FLOAT,      // 1.5, 2.0e-3
     TOK_IDENT,
     TOK_STRING,
 
@@ -79,12 +80,49 @@ typedef enum {
     TOK_AND,
     TOK_OR,
     TOK_STRLEN,
-    TOK_WHERE
+    TOK_WHERE,
+    TOK_UNROLL,     // unroll
+    TOK_PREFETCH,   // prefetch
+    TOK_AMP,        // &
+    TOK_PIPE,       // |
+    TOK_CARET,      // ^
+    TOK_TILDE,      // ~
+    TOK_SHL,        // <<
+    TOK_SHR,        // >>
+    TOK_POPCNT,     // popcnt
+    TOK_LZCNT,      // lzcnt
+    TOK_TZCNT,      // tzcnt
+    TOK_BSWAP,      // bswap
+    TOK_MIN,        // min
+    TOK_MAX,        // max
+    TOK_ABS,        // abs
+    TOK_SQRT,       // sqrt
+    TOK_SELECT,     // select
+    TOK_LIKELY,     // likely
+    TOK_UNLIKELY,   // unlikely
+    TOK_FIND,       // find         — the TOK_FIND..TOK_SPLIT_LINES block is kept contiguous
+    TOK_FIND_BYTE,  // find_byte
+    TOK_COUNT_BYTE, // count_byte
+    TOK_SPLIT_LINES,// split_lines
+    TOK_COPY,       // copy         — TOK_COPY..TOK_COMPARE kept contiguous too
+    TOK_FILL,       // fill
+    TOK_COMPARE,    // compare
+    TOK_MAP_FILE,   // map_file
+    TOK_UNMAP,      // unmap
+    TOK_SUBMIT_READ,        // submit_read  — TOK_SUBMIT_READ..TOK_WAIT_COMPLETIONS contiguous
+    TOK_SUBMIT_WRITE,       // submit_write
+    TOK_WAIT_COMPLETIONS,   // wait_completions
+    TOK_READV,      // readv        — TOK_READV..TOK_COPY_FILE contiguous
+    TOK_WRITEV,     // writev
+    TOK_COPY_FILE   // copy_file
 } TokenType;
 
 typedef struct {
-    TokenType type;
-    char      value[64];
+    TokenType   type;
+    char        value[64];  // NUL-terminated copy of the text, cut at 63 bytes
+    const char *start;      // the full text in the source — a string's without quotes
+    int         len;
+    int         line;       // 1-based source line
 } Token;
 
 // ─────────────────────────────────────────
@@ -132,6 +170,7 @@ int        find_field(StructDef *sd, const char *field, int *out_offset, DataTyp
 // ─────────────────────────────────────────
 typedef enum {
     NODE_NUMBER,
+    NODE_FLOAT,         // 1.5 — double literal
     NODE_BOOL,
     NODE_IDENT,
     NODE_STRING,
@@ -179,7 +218,19 @@ typedef enum {
     NODE_AND,
     NODE_OR,
     NODE_NEG,
-    NODE_STRLEN
+    NODE_STRLEN,
+    NODE_PREFETCH,  // prefetch(ptr, i, hint) — cache hint for ptr[i], never faults
+    NODE_CAST,      // int(x) / float(x) — dtype is the target type
+    NODE_BITNOT,    // ~x
+    NODE_INTRINSIC, // popcnt(x), min(a, b), ... — ival is the builtin's TOK_ kind
+    NODE_SELECT,    // select(cond, a, b) — both arms evaluated, no branch
+    NODE_SLICE,     // s[a:b] — left is the base, children are start [, end]
+    NODE_SCAN,      // find(s, t), count_byte(s, b), ... — ival is the builtin's TOK_ kind
+    NODE_MEMOP,     // copy(dst, src, n), fill(dst, b, n), compare(a, b, n) — ival as above
+    NODE_MAP_FILE,  // map_file(path [, advice]) — the file as a read-only str
+    NODE_UNMAP,     // unmap(s) — munmap a map_file result
+    NODE_IO,        // submit_read / submit_write / wait_completions — ival is the TOK_ kind
+    NODE_XFER       // readv(fd, iov, n), writev(fd, iov, n), copy_file(in, out, n) — ival as above
                   
 } NodeType;
 
@@ -190,6 +241,7 @@ struct Node {
 
     char     name[64];      // ident/fn/struct/field name
     int      ival;          // number / bool value
+    double   fval;          // float literal value
     int      array_size;    // array size for ARRAY_DECL
     char     op[3];         // operator
     char     sval[256];     // string value / field name for field access
@@ -200,6 +252,11 @@ struct Node {
 
     Node    *children[64];
     int      child_count;
+
+    int      unroll;        // for loops: 'unroll N' factor, 0 = pick automatically
+    int      hint;          // if / elif: 1 likely, -1 unlikely, 0 none
+    int      prof_id;       // first profile counter + 1, 0 = not counted
+    int      line;          // source line, for debug info
 };
 
 // ─────────────────────────────────────────
@@ -211,10 +268,32 @@ struct Node {
 extern Token tokens[MAX_TOKENS];
 extern int   token_count;
 
+// ─────────────────────────────────────────
+// COMPILE OPTIONS
+// filled by runner from command-line flags, read by codegen
+// ─────────────────────────────────────────
+typedef struct {
+    long l1_cache;      // L1d bytes used to size loop tiles, 0 = detect
+    long l2_cache;      // L2 bytes, 0 = detect
+    int  tile_size;     // force every tile edge, 0 = derive from cache, -1 = no tiling
+    int  prefetch;      // auto prefetch distance in loop iterations, 0 = off
+    const char *profile_generate;   // instrument, write counts here at exit — NULL = off
+    const char *profile_use;        // read counts from here to steer codegen — NULL = off
+    int  debug;                     // -g: %line source mapping for DWARF line info
+    const char *source_path;        // .k file named in the line info
+    const char *instrument;         // call counts + cycles report, "" = stderr — NULL = off
+    const char *trace_alloc;        // alloc / free trace + heap summary, "" = stderr — NULL = off
+    const char *remarks;            // optimization remarks, "" = stderr — NULL = off
+    int  remarks_json;              // remarks as JSON lines instead of text
+    int  write_thread;              // flush output chunks from a background thread
+} Options;
+
+extern Options options;
+
 // ─────────────────────────────────────────
 // FUNCTION DECLARATIONS
 // ─────────────────────────────────────────
-void  tokenize(const char *src);
+void  tokenize(const char *src, long len);  // src needn't be NUL-terminated
 Node *parse(void);
 void  generate(Node *root, const char *out_file);
 Node *new_node(NodeType type);
@@ -1,52 +1,225 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <cpuid.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "../include/main.h"
 
+Options options;
+
 // ─────────────────────────────────────────
 // ASM hot path functions (codegen_asm.asm)
 // ─────────────────────────────────────────
 extern void buf_write_str(char *buf, size_t *cursor, const char *str);
+extern void buf_write_mem(char *buf, size_t *cursor, const char *ptr, size_t len);
 extern void buf_write_int(char *buf, size_t *cursor, long val);
-extern int  buf_flush(char *buf, size_t len, const char *filename);
+extern int  buf_flush(int fd, const char *buf, size_t len);
 
 // ─────────────────────────────────────────
-// Output buffer — 4MB
-// String buffer — 64KB for .data string literals
+// Output stream — out_buf is the current 256KB chunk of output.s,
+// flushed to the file once full. with --write-thread a background
+// thread writes one chunk while codegen fills the other
+// String buffer — .data lines, appended after the code. chunks that
+// fill up spill to a temp file, so memory stays bounded either way
 // ─────────────────────────────────────────
-#define OUT_BUF_SIZE (4 * 1024 * 1024)
-#define STR_BUF_SIZE (64 * 1024)
-
-static char   out_buf[OUT_BUF_SIZE];
+#define OUT_CHUNK    (256 * 1024)
+#define STR_CHUNK    (64 * 1024)
+#define LINE_MAX     (64 * 1024)    // most one line of output adds between checks
+#define BUF_SLACK    64             // the writers store whole chunks past the cursor
+#define OUT_BUF_SIZE (OUT_CHUNK + LINE_MAX + BUF_SLACK)
+#define STR_BUF_SIZE (STR_CHUNK + LINE_MAX + BUF_SLACK)
+
+static char   out_chunks[2][OUT_BUF_SIZE];
+static char  *out_buf    = out_chunks[0];
 static size_t out_cursor = 0;
+static int    out_fd     = -1;
 static char   str_buf[STR_BUF_SIZE];
 static size_t str_cursor = 0;
+static FILE  *str_spill  = NULL;        // full str_buf chunks, oldest first
+
+static pthread_t       wr_thread;
+static pthread_mutex_t wr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wr_cond = PTHREAD_COND_INITIALIZER;
+static const char     *wr_ptr  = NULL;  // chunk handed to the writer, NULL = slot free
+static size_t          wr_len  = 0;
+static int             wr_done = 0;
+static int             wr_failed = 0;
+
+static void stream_fail(void) {
+    fprintf(stderr, "Codegen error: failed to write output file\n");
+    exit(1);
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&wr_lock);
+    for (;;) {
+        while (!wr_ptr && !wr_done) pthread_cond_wait(&wr_cond, &wr_lock);
+        if (!wr_ptr) break;                         // done and drained
+        const char *p = wr_ptr;
+        size_t      n = wr_len;
+        pthread_mutex_unlock(&wr_lock);
+        int failed = buf_flush(out_fd, p, n) != 0;
+        pthread_mutex_lock(&wr_lock);
+        wr_failed |= failed;
+        wr_ptr = NULL;
+        pthread_cond_broadcast(&wr_cond);
+    }
+    pthread_mutex_unlock(&wr_lock);
+    return NULL;
+}
+
+// p must stay untouched until the next out_write returns — the writer
+// thread may still be on it
+static void out_write(const char *p, size_t n) {
+    if (!options.write_thread) {
+        if (buf_flush(out_fd, p, n) != 0) stream_fail();
+        return;
+    }
+    pthread_mutex_lock(&wr_lock);
+    while (wr_ptr) pthread_cond_wait(&wr_cond, &wr_lock);
+    wr_ptr = p;
+    wr_len = n;
+    pthread_cond_broadcast(&wr_cond);
+    pthread_mutex_unlock(&wr_lock);
+}
+
+// hand the chunk off and continue in the other one — the writer has
+// finished with it by the time out_write accepts this one
+static void out_flush(void) {
+    if (!out_cursor) return;
+    out_write(out_buf, out_cursor);
+    if (options.write_thread)
+        out_buf = out_buf == out_chunks[0] ? out_chunks[1] : out_chunks[0];
+    out_cursor = 0;
+}
+
+static void str_flush(void) {
+    if (!str_spill && !(str_spill = tmpfile())) stream_fail();
+    if (buf_flush(fileno(str_spill), str_buf, str_cursor) != 0) stream_fail();
+    str_cursor = 0;
+}
+
+// called before each line — a full chunk goes out before the next line starts
+static void stream_check(void) {
+    if (out_cursor > OUT_CHUNK + LINE_MAX || str_cursor > STR_CHUNK + LINE_MAX) {
+        fprintf(stderr, "Codegen error: output buffer overrun\n");
+        exit(1);
+    }
+    if (out_cursor >= OUT_CHUNK) out_flush();
+    if (str_cursor >= STR_CHUNK) str_flush();
+}
+
+static void stream_open(const char *path) {
+    out_buf    = out_chunks[0];
+    out_cursor = 0;
+    str_cursor = 0;
+    str_spill  = NULL;
+    out_fd     = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        fprintf(stderr, "Codegen error: cannot open output file '%s'\n", path);
+        exit(1);
+    }
+    if (options.write_thread) {
+        wr_ptr = NULL;
+        wr_done = wr_failed = 0;
+        if (pthread_create(&wr_thread, NULL, writer_main, NULL) != 0) options.write_thread = 0;
+    }
+}
+
+// the code is out — append the data lines: spilled chunks, then the rest
+static void stream_close(void) {
+    if (str_spill) {
+        out_flush();
+        rewind(str_spill);
+        size_t n;
+        while ((n = fread(out_buf, 1, OUT_CHUNK, str_spill)) > 0) {
+            out_cursor = n;
+            out_flush();
+        }
+        fclose(str_spill);
+        str_spill = NULL;
+    }
+    out_flush();
+    out_write(str_buf, str_cursor);
+    if (options.write_thread) {
+        pthread_mutex_lock(&wr_lock);
+        wr_done = 1;
+        pthread_cond_broadcast(&wr_cond);
+        pthread_mutex_unlock(&wr_lock);
+        pthread_join(wr_thread, NULL);
+        if (wr_failed) stream_fail();
+    }
+    if (close(out_fd) != 0) stream_fail();
+    out_fd = -1;
+}
 
 // ─────────────────────────────────────────
 // Emit helpers
 // ─────────────────────────────────────────
 static void emit_str(const char *s) {
+    stream_check();
     buf_write_str(out_buf, &out_cursor, s);
 }
 static void emit(const char *s) {
-    buf_write_str(out_buf, &out_cursor, "    ");
+    stream_check();
+    buf_write_mem(out_buf, &out_cursor, "    ", 4);
     buf_write_str(out_buf, &out_cursor, s);
 }
 static void emitln(const char *s) {
-    buf_write_str(out_buf, &out_cursor, "    ");
+    stream_check();
+    buf_write_mem(out_buf, &out_cursor, "    ", 4);
     buf_write_str(out_buf, &out_cursor, s);
-    buf_write_str(out_buf, &out_cursor, "\n");
+    buf_write_mem(out_buf, &out_cursor, "\n", 1);
 }
+static void cse_clear();
+
+// labels are join points — r11 may hold something else on the other edge
 static void emit_label(int id) {
+    cse_clear();
+    stream_check();
     buf_write_str(out_buf, &out_cursor, ".L");
     buf_write_int(out_buf, &out_cursor, id);
     buf_write_str(out_buf, &out_cursor, ":\n");
 }
+// out-of-line code for rarely taken paths. the assembler keeps .text.cold
+// separate, so it no longer splits the hot path across cache lines
+#define TEXT_HOT  "section .text\n"
+#define TEXT_COLD "section .text.cold progbits alloc exec nowrite align=16\n"
+static const char *text_section = TEXT_HOT;    // where the current function lives
+
+static int cold_depth = 0;              // nested unlikely regions stay in .text.cold
+
+static void emit_cold_begin(void) {
+    if (cold_depth++ == 0) buf_write_str(out_buf, &out_cursor, TEXT_COLD);
+}
+static void emit_cold_end(void) {
+    if (--cold_depth == 0) buf_write_str(out_buf, &out_cursor, text_section);
+    cse_clear();                        // the hot path doesn't run the cold code
+}
 static void emit_named_label(const char *name) {
+    stream_check();
     buf_write_str(out_buf, &out_cursor, name);
     buf_write_str(out_buf, &out_cursor, ":\n");
 }
+// frame slot operand [rbp-off], mid-line
+static void write_mem(int off) {
+    buf_write_str(out_buf, &out_cursor, "[rbp-");
+    buf_write_int(out_buf, &out_cursor, off);
+    buf_write_str(out_buf, &out_cursor, "]");
+}
+// prefix [rbp-off] suffix — e.g. emit_mem("mov rax, ", 8, "") → mov rax, [rbp-8]
+static void emit_mem(const char *prefix, int off, const char *suffix) {
+    emit(prefix);
+    write_mem(off);
+    buf_write_str(out_buf, &out_cursor, suffix);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
 static void emit_jmp(const char *instr, int id) {
+    stream_check();
     buf_write_str(out_buf, &out_cursor, "    ");
     buf_write_str(out_buf, &out_cursor, instr);
     buf_write_str(out_buf, &out_cursor, " .L");
@@ -69,6 +242,27 @@ static int param_count = 0;
 
 static int new_label() { return label_count++; }
 
+// functions defined in this program — lets call sites see callee signatures
+typedef struct {
+    char     name[64];
+    int      param_count;
+    DataType param_types[64];
+    DataType ret;
+} FnSig;
+static FnSig fn_table[256];
+static int   fn_count = 0;
+
+static FnSig *find_fn(const char *name) {
+    for (int i = 0; i < fn_count; i++)
+        if (strcmp(fn_table[i].name, name) == 0) return &fn_table[i];
+    return NULL;
+}
+
+// function currently being generated — tail calls jump back to its entry
+static char     cur_fn[64];
+static int      cur_fn_entry = -1;     // label after prologue, -1 = top level
+static DataType cur_fn_ret   = DTYPE_INT;
+
 static int var_offset(const char *name) {
     for (int i = var_count - 1; i >= 0; i--)
         if (strcmp(var_table[i].name, name) == 0) return var_table[i].offset;
@@ -86,8 +280,9 @@ static DataType var_dtype(const char *name) {
     return DTYPE_INT;
 }
 
+// a str takes two slots — pointer at [rbp-off], length at [rbp-off+8]
 static int add_var(const char *name, DataType dtype) {
-    stack_top += 8;
+    stack_top += dtype == DTYPE_STR ? 16 : 8;
     var_table[var_count].offset     = stack_top;
     var_table[var_count].dtype      = dtype;
     var_table[var_count].array_size = 0;
@@ -130,6 +325,10 @@ static const char *var_struct_type(const char *name) {
     return "";
 }
 
+// loop var + start/limit/tile-control/tile-end (tiled) or limit/step (plain)
+#define FOR_SLOTS  5
+#define LICM_SLOTS 4    // per loop, for invariant values hoisted to the frame
+
 // ─────────────────────────────────────────
 // Count local variables for exact stack sizing
 // ─────────────────────────────────────────
@@ -142,15 +341,18 @@ static int count_vars(Node *n) {
             StructDef *sd = find_struct(n->right->name);
             count = sd ? sd->field_count : 1;
         } else {
-            count = 1;
+            // str is pointer + length — untyped lets may turn out to be one
+            count = (n->dtype == DTYPE_STR || n->dtype == DTYPE_UNKNOWN) ? 2 : 1;
         }
     }
     if (n->type == NODE_ARRAY_DECL)  count = n->array_size;
     if (n->type == NODE_ARRAY_INIT)  count = 0;
     if (n->type == NODE_STRUCT_DEF)  count = 0;  // no stack space
     if (n->type == NODE_ASSIGN_MULTI) count = 2;
-    if (n->type == NODE_FOR)         count = 1;
-    if (n->type == NODE_FOR_IF)      count = 1;
+    if (n->type == NODE_FOR)         count = FOR_SLOTS + LICM_SLOTS;
+    if (n->type == NODE_FOR_IF)      count = 3 + LICM_SLOTS;   // loop var, limit, step
+    if (n->type == NODE_WHILE || n->type == NODE_DO_WHILE) count = LICM_SLOTS;
+    if (n->type == NODE_MATCH)       count = 1;     // subject
     if (n->left)  count += count_vars(n->left);
     if (n->right) count += count_vars(n->right);
     for (int i = 0; i < n->child_count; i++)
@@ -173,7 +375,9 @@ static void emit_cmp(const char *op) {
     emitln("movzx rax, al");
 }
 
-// CSE cache — stores recently computed binop expressions
+// CSE cache — remembers the binop whose result is sitting in r11.
+// r11 holds one value, so there is one live entry; it dies at labels,
+// calls/syscalls (r11 is caller-saved) and writes to either operand
 typedef struct {
     char lhs[64];   // left operand name
     char rhs[64];   // right operand name  
@@ -195,19 +399,29 @@ static int cse_lookup(const char *lhs, const char *op, const char *rhs) {
 }
 
 static void cse_store(const char *lhs, const char *op, const char *rhs) {
-    if (cse_count >= 32) return;
+    cse_count = 0;
     strncpy(cse_cache[cse_count].lhs, lhs, 63);
     strncpy(cse_cache[cse_count].op,  op,  3);
     strncpy(cse_cache[cse_count].rhs, rhs, 63);
     cse_count++;
 }
 
+// variable written — drop cached results that read it
+static void cse_invalidate(const char *name) {
+    for (int i = 0; i < cse_count; i++)
+        if (strcmp(cse_cache[i].lhs, name) == 0 || strcmp(cse_cache[i].rhs, name) == 0) {
+            cse_clear();
+            return;
+        }
+}
+
 // ─────────────────────────────────────────
 // Linear Scan Register Allocator
 // Based on Poletto & Sarkar 1999
 // ─────────────────────────────────────────
-#define MAX_REGS 2
-static const char *alloc_regs[MAX_REGS] = {"r12", "r13"};
+#define MAX_REGS  4
+#define SAFE_REGS 2     // r12/r13 survive libc calls — r8/r9 only in call-free loops
+static const char *alloc_regs[MAX_REGS] = {"r12", "r13", "r8", "r9"};
 
 typedef struct {
     char name[64];  // variable name
@@ -238,12 +452,14 @@ static int regalloc_find(const char *name) {
 }
 
 // assign a register to a variable — returns reg index or -1 if none free
-static int regalloc_assign(const char *name) {
+// call_free = 1 when nothing in the variable's range calls out
+static int regalloc_assign(const char *name, int call_free) {
     // already assigned?
     int existing = regalloc_find(name);
     if (existing >= 0) return existing;
     // find free register
-    for (int i = 0; i < MAX_REGS; i++) {
+    int limit = call_free ? MAX_REGS : SAFE_REGS;
+    for (int i = 0; i < limit; i++) {
         if (reg_free[i]) {
             reg_free[i] = 0;
             strncpy(reg_owner[i], name, 63);
@@ -279,10 +495,37 @@ static void loop_pop() { loop_depth--; }
 static int  loop_break()    { return break_stack[loop_depth - 1]; }
 static int  loop_continue() { return continue_stack[loop_depth - 1]; }
 
+// unrolled copy k reads the loop counter as group base + k*step
+static char iv_name[64];
+static int  iv_delta = 0;
+
+// LICM hoist table — values computed once in a loop preheader. gen_expr
+// reads a hoisted expression (matched by node) from its register or frame
+// slot; ptr array bases held in registers are matched by array name
+#define MAX_HOISTS 32
+typedef struct {
+    Node *expr;         // hoisted expression, NULL for a ptr base
+    char  name[64];     // ptr array whose base is in reg
+    char  owner[24];    // regalloc owner released at loop exit, "" if shared
+    int   reg;          // alloc_regs index, -1 = frame slot
+    int   off;          // frame slot when reg < 0
+} Hoist;
+
+static Hoist hoists[MAX_HOISTS];
+static int   hoist_count = 0;
+
+// register holding the base of ptr array `name`, -1 if not hoisted
+static int hoisted_base(const char *name) {
+    for (int i = hoist_count - 1; i >= 0; i--)
+        if (!hoists[i].expr && strcmp(hoists[i].name, name) == 0) return hoists[i].reg;
+    return -1;
+}
+
 
 
 // forward declaration
 static int node_uses_var(Node *n, const char *varname);
+static int node_equal(Node *a, Node *b);
 
 // returns 1 if node accesses an array using varname as index
 static int block_accesses_array(Node *n, const char *varname) {
@@ -303,15 +546,744 @@ static int get_loop_range(Node *limit, Node *start) {
     return -1;
 }
 
+// ─────────────────────────────────────────
+// Induction-variable strength reduction
+// in an innermost for loop, arr[scale*i + inv + c] (inv loop-invariant, c
+// literal) is addressed through a running pointer that starts at element
+// scale*i + inv and moves by scale*step elements per iteration — the access
+// becomes [reg + 8c]. stack arrays grow down, so their pointers step by -8
+// ─────────────────────────────────────────
+#define MAX_IV_PTRS 4
+typedef struct {
+    char  array[64];
+    char  var[64];      // induction variable
+    Node *inv;          // invariant part of the index, NULL = none
+    int   scale;        // index = scale*var + inv + c
+    int   elem;         // bytes per element step: 8 for ptr, -8 for stack arrays
+    int   bump;         // bytes the pointer moves per iteration
+    int   reg;          // alloc_regs index holding the pointer
+    char  owner[24];    // regalloc owner
+} IvPtr;
+
+static IvPtr iv_ptrs[MAX_IV_PTRS];
+static int   iv_ptr_count = 0;
+
+// split idx into scale*var + inv + c — returns 0 if it isn't of that form
+static int iv_split(Node *idx, const char *var, Node **inv, int *scale, int *c) {
+    if (idx->type == NODE_IDENT && strcmp(idx->name, var) == 0) {
+        *scale = 1;
+        return 1;
+    }
+    if (idx->type != NODE_BINOP) return 0;
+    Node *l = idx->left, *r = idx->right;
+    if (strcmp(idx->op, "*") == 0) {
+        if (l->type == NODE_IDENT && strcmp(l->name, var) == 0 && r->type == NODE_NUMBER) {
+            *scale = r->ival;
+            return 1;
+        }
+        if (r->type == NODE_IDENT && strcmp(r->name, var) == 0 && l->type == NODE_NUMBER) {
+            *scale = l->ival;
+            return 1;
+        }
+        return 0;
+    }
+    if (strcmp(idx->op, "-") == 0) {
+        if (r->type != NODE_NUMBER || !iv_split(l, var, inv, scale, c)) return 0;
+        *c -= r->ival;
+        return 1;
+    }
+    if (strcmp(idx->op, "+") != 0) return 0;
+    if (r->type == NODE_NUMBER && iv_split(l, var, inv, scale, c)) { *c += r->ival; return 1; }
+    if (l->type == NODE_NUMBER && iv_split(r, var, inv, scale, c)) { *c += l->ival; return 1; }
+    if (*inv) return 0;                             // one invariant term at most
+    if (!node_uses_var(r, var) && iv_split(l, var, inv, scale, c)) { *inv = r; return 1; }
+    if (!node_uses_var(l, var) && iv_split(r, var, inv, scale, c)) { *inv = l; return 1; }
+    return 0;
+}
+
+// running pointer for array access n (ARRAY_ACCESS / ARRAY_ASSIGN) — sets
+// reg and the byte displacement, returns 0 if no pointer covers it
+static int iv_lookup(Node *n, int *reg, int *disp) {
+    for (int i = 0; i < iv_ptr_count; i++) {
+        IvPtr *p = &iv_ptrs[i];
+        if (strcmp(p->array, n->name) != 0) continue;
+        Node *inv = NULL;
+        int scale = 0, c = 0;
+        if (!iv_split(n->left, p->var, &inv, &scale, &c)) continue;
+        if (scale != p->scale || !node_equal(inv, p->inv)) continue;
+        // unrolled copy k sees var + k*step
+        if (iv_delta && strcmp(iv_name, p->var) == 0) c += scale * iv_delta;
+        *reg  = p->reg;
+        *disp = p->elem * c;
+        return 1;
+    }
+    return 0;
+}
+
+// 1 if every access of array under n goes through a running pointer
+static int iv_covers(Node *n, const char *array) {
+    if (!n) return 1;
+    if ((n->type == NODE_ARRAY_ACCESS || n->type == NODE_ARRAY_ASSIGN) &&
+        strcmp(n->name, array) == 0) {
+        int reg, disp;
+        if (!iv_lookup(n, &reg, &disp)) return 0;
+    }
+    if (!iv_covers(n->left, array) || !iv_covers(n->right, array)) return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!iv_covers(n->children[i], array)) return 0;
+    return 1;
+}
+
+// move the running pointers of loop counter var by `iters` iterations
+static void iv_advance(const char *var, int iters) {
+    for (int i = 0; i < iv_ptr_count; i++) {
+        if (strcmp(iv_ptrs[i].var, var) != 0) continue;
+        emit("add ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[iv_ptrs[i].reg]);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        buf_write_int(out_buf, &out_cursor, iv_ptrs[i].bump * iters);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+}
+
+// [reg+disp] / [reg-disp]
+static void write_iv_mem(int reg, int disp) {
+    buf_write_str(out_buf, &out_cursor, "[");
+    buf_write_str(out_buf, &out_cursor, alloc_regs[reg]);
+    if (disp) {
+        buf_write_str(out_buf, &out_cursor, disp > 0 ? "+" : "-");
+        buf_write_int(out_buf, &out_cursor, disp > 0 ? disp : -disp);
+    }
+    buf_write_str(out_buf, &out_cursor, "]");
+}
+
+
+
+// ─────────────────────────────────────────
+// Optimization remarks
+// --remarks[=file]: passes report what they did (applied) or why they backed
+// off (missed) at a source line — text, or one JSON object per line with
+// --remarks-format=json. unrolled copies of a body would repeat the same
+// remark, so each distinct one is reported once
+// ─────────────────────────────────────────
+#define MAX_REMARKS 4096
+
+static FILE          *remarks_out = NULL;
+static unsigned long  remark_seen[MAX_REMARKS];
+static int            remark_count = 0;
+
+static void json_str(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if ((unsigned char)*s < 0x20) { fprintf(f, "\\u%04x", *s); continue; }
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void remark(Node *n, const char *pass, int applied, const char *fmt, ...) {
+    if (!remarks_out) return;
+    char msg[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    // FNV-1a over line, pass and message
+    int line = n ? n->line : 0;
+    unsigned long h = 14695981039346656037UL ^ (unsigned long)(line * 2 + applied);
+    for (const char *s = pass; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211UL;
+    for (const char *s = msg;  *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211UL;
+    for (int i = 0; i < remark_count; i++)
+        if (remark_seen[i] == h) return;
+    if (remark_count < MAX_REMARKS) remark_seen[remark_count++] = h;
+
+    const char *file   = options.source_path ? options.source_path : "";
+    const char *status = applied ? "applied" : "missed";
+    if (options.remarks_json) {
+        fprintf(remarks_out, "{\"file\": ");
+        json_str(remarks_out, file);
+        fprintf(remarks_out, ", \"line\": %d, \"pass\": \"%s\", \"status\": \"%s\", \"message\": ",
+                line, pass, status);
+        json_str(remarks_out, msg);
+        fprintf(remarks_out, "}\n");
+    } else {
+        fprintf(remarks_out, "%s:%d: %s [%s]: %s\n", file, line, status, pass, msg);
+    }
+}
+
+// loop counter register choice — reg < 0 means it lives in the frame
+static void remark_counter(Node *n, int reg, int calls_k) {
+    if (reg >= 0)
+        remark(n, "regalloc", 1, "counter '%s' kept in %s", n->name, alloc_regs[reg]);
+    else
+        remark(n, "regalloc", 0, "counter '%s' spilled: %s", n->name,
+               calls_k ? "body calls a K function" : "no free registers");
+}
+
+// ─────────────────────────────────────────
+// String literals
+// each distinct literal is interned once as strN in .rodata, with
+// strN_len equ <bytes> beside it — repeats share the label, and strlen
+// of a literal is that constant
+// ─────────────────────────────────────────
+#define STR_TABLE (2 * MAX_NODES)       // open addressing, never more than half full
+
+static int         str_slots[STR_TABLE];    // id + 1, 0 = empty
+static const char *str_text[MAX_NODES];     // id → text, the node's sval
+
+static int intern_str(const char *s) {
+    unsigned long h = 14695981039346656037UL;           // FNV-1a
+    for (const char *c = s; *c; c++) h = (h ^ (unsigned char)*c) * 1099511628211UL;
+    int i = (int)(h & (STR_TABLE - 1));
+    while (str_slots[i]) {
+        if (strcmp(str_text[str_slots[i] - 1], s) == 0) return str_slots[i] - 1;
+        i = (i + 1) & (STR_TABLE - 1);
+    }
+    str_text[str_count] = s;
+    str_slots[i] = str_count + 1;
+    return str_count++;
+}
 
+// every interned literal, in first-use order
+static void emit_str_literals(void) {
+    if (!str_count) return;
+    emit_str("\nsection .rodata\n");
+    for (int i = 0; i < str_count; i++) {
+        emit("str");
+        buf_write_int(out_buf, &out_cursor, i);
+        buf_write_str(out_buf, &out_cursor, " db \"");
+        buf_write_str(out_buf, &out_cursor, str_text[i]);
+        buf_write_str(out_buf, &out_cursor, "\", 0\n");
+        emit("str");
+        buf_write_int(out_buf, &out_cursor, i);
+        buf_write_str(out_buf, &out_cursor, "_len equ ");
+        buf_write_int(out_buf, &out_cursor, (long)strlen(str_text[i]));
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+}
 
 // ─────────────────────────────────────────
 // Code generation
 // ─────────────────────────────────────────
 static void gen_expr(Node *n);
+static void gen_str(Node *n);
 static void gen_stmt(Node *n);
+static int  ta_site(int line);
+static void gen_scan(Node *n);
+static void gen_memop(Node *n);
+static int  memop_inline(Node *n);
+static void gen_map_file(Node *n);
+static void gen_io(Node *n);
+static void gen_xfer(Node *n);
+
+// 1 if evaluating n only touches rax — safe to park the other operand in r10
+static int expr_is_leaf(Node *n) {
+    return n->type == NODE_NUMBER || n->type == NODE_BOOL   ||
+           n->type == NODE_IDENT  || n->type == NODE_STRING ||
+           n->type == NODE_FIELD_ACCESS || n->type == NODE_ADDR ||
+           n->type == NODE_DEREF;
+}
+
+// load a value hoisted out of the enclosing loops — returns 0 if n isn't one
+static int gen_hoisted(Node *n) {
+    for (int i = hoist_count - 1; i >= 0; i--) {
+        if (hoists[i].expr != n) continue;
+        if (hoists[i].reg >= 0) {
+            emit("mov rax, ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[hoists[i].reg]);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        } else {
+            emit_mem("mov rax, ", hoists[i].off, "");
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// ─────────────────────────────────────────
+// Floating point — SSE2 scalar doubles
+// float expressions are evaluated into xmm0 by gen_fexpr. generic code that
+// moves values through rax (stores, pushes, hoisting) carries the raw bits
+// ─────────────────────────────────────────
+static int flt_count = 0;
+
+static int is_cmp_op(const char *op) {
+    return !strcmp(op, "==") || !strcmp(op, "!=") || !strcmp(op, "<") ||
+           !strcmp(op, ">")  || !strcmp(op, "<=") || !strcmp(op, ">=");
+}
+
+// + - * / — the only operators with a float form
+static int is_arith_op(const char *op) {
+    return op[1] == 0 && strchr("+-*/", op[0]) != NULL;
+}
+
+// static type of an expression — float-typed ones are evaluated in xmm0
+static DataType expr_dtype(Node *n) {
+    switch (n->type) {
+    case NODE_FLOAT:  return DTYPE_FLOAT;
+    case NODE_CAST:   return n->dtype;
+    case NODE_STRING: return DTYPE_STR;
+    case NODE_SLICE:  return DTYPE_STR;
+    case NODE_MAP_FILE: return DTYPE_STR;
+    case NODE_BOOL:   return DTYPE_BOOL;
+    case NODE_ADDR:
+    case NODE_ALLOC:  return DTYPE_PTR;
+    case NODE_IDENT:  return var_dtype(n->name);
+    case NODE_NEG:    return expr_dtype(n->right);
+    case NODE_FIELD_ACCESS: {
+        StructDef *sd = find_struct(var_struct_type(n->name));
+        int foff = 0;
+        DataType ftype = DTYPE_INT;
+        if (sd) find_field(sd, n->sval, &foff, &ftype);
+        return ftype;
+    }
+    case NODE_ARRAY_ACCESS: {
+        DataType dt = var_dtype(n->name);
+        return dt == DTYPE_PTR ? DTYPE_INT : dt;    // ptr elements are ints
+    }
+    case NODE_FN_CALL: {
+        FnSig *sig = find_fn(n->name);
+        return sig ? sig->ret : DTYPE_INT;
+    }
+    case NODE_BINOP:
+        if (!is_arith_op(n->op)) return DTYPE_INT;
+        if (expr_dtype(n->left) == DTYPE_FLOAT || expr_dtype(n->right) == DTYPE_FLOAT)
+            return DTYPE_FLOAT;
+        return DTYPE_INT;
+    case NODE_SELECT: {
+        DataType a = expr_dtype(n->children[1]), b = expr_dtype(n->children[2]);
+        return (a == DTYPE_FLOAT || b == DTYPE_FLOAT) ? DTYPE_FLOAT : a;
+    }
+    case NODE_INTRINSIC:
+        if (n->ival == TOK_SQRT) return DTYPE_FLOAT;
+        if (n->ival == TOK_MIN || n->ival == TOK_MAX || n->ival == TOK_ABS)
+            for (int i = 0; i < n->child_count; i++)
+                if (expr_dtype(n->children[i]) == DTYPE_FLOAT) return DTYPE_FLOAT;
+        return DTYPE_INT;
+    default:
+        return DTYPE_INT;
+    }
+}
+
+// float literal → .data constant fltN holding its raw bits
+static int float_const(double v) {
+    long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    int id = flt_count++;
+    buf_write_str(str_buf, &str_cursor, "    flt");
+    buf_write_int(str_buf, &str_cursor, id);
+    buf_write_str(str_buf, &str_cursor, " dq ");
+    buf_write_int(str_buf, &str_cursor, bits);
+    buf_write_str(str_buf, &str_cursor, "\n");
+    return id;
+}
+
+// load a float literal or float variable straight into xmm — 0 if n isn't one
+static int gen_fleaf(Node *n, const char *xmm) {
+    if (n->type == NODE_FLOAT) {
+        int id = float_const(n->fval);
+        emit("movsd ");
+        buf_write_str(out_buf, &out_cursor, xmm);
+        buf_write_str(out_buf, &out_cursor, ", [rel flt");
+        buf_write_int(out_buf, &out_cursor, id);
+        buf_write_str(out_buf, &out_cursor, "]\n");
+        return 1;
+    }
+    if (n->type == NODE_IDENT && var_dtype(n->name) == DTYPE_FLOAT) {
+        emit("movsd ");
+        buf_write_str(out_buf, &out_cursor, xmm);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        write_mem(var_offset(n->name));
+        buf_write_str(out_buf, &out_cursor, "\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void gen_fexpr(Node *n);
+
+// both operands of a float op — a → xmm0, b → xmm1
+static void gen_fpair(Node *a, Node *b) {
+    gen_fexpr(a);
+    if (gen_fleaf(b, "xmm1")) return;
+    if (expr_is_leaf(b) && expr_dtype(b) != DTYPE_FLOAT) {
+        gen_expr(b);                    // int leaf only touches rax
+        emitln("cvtsi2sd xmm1, rax");
+        return;
+    }
+    emitln("movq rax, xmm0");
+    emitln("push rax");
+    gen_fexpr(b);
+    emitln("movapd xmm1, xmm0");
+    emitln("pop rax");
+    emitln("movq xmm0, rax");
+}
+
+// evaluate n as a double into xmm0 — int expressions are converted
+static void gen_fexpr(Node *n) {
+    if (expr_dtype(n) != DTYPE_FLOAT) {
+        gen_expr(n);
+        emitln("cvtsi2sd xmm0, rax");
+        return;
+    }
+    if (hoist_count && gen_hoisted(n)) {
+        emitln("movq xmm0, rax");
+        return;
+    }
+    if (gen_fleaf(n, "xmm0")) return;
+    switch (n->type) {
+    case NODE_BINOP:
+        gen_fpair(n->left, n->right);
+        if      (strcmp(n->op, "+") == 0) emitln("addsd xmm0, xmm1");
+        else if (strcmp(n->op, "-") == 0) emitln("subsd xmm0, xmm1");
+        else if (strcmp(n->op, "*") == 0) emitln("mulsd xmm0, xmm1");
+        else                              emitln("divsd xmm0, xmm1");
+        break;
+    case NODE_NEG:
+        gen_fexpr(n->right);
+        emitln("movq rax, xmm0");
+        emitln("btc rax, 63");          // flip the sign bit
+        emitln("movq xmm0, rax");
+        break;
+    case NODE_CAST:
+        gen_fexpr(n->right);            // float(x)
+        break;
+    case NODE_INTRINSIC:
+        if (n->ival == TOK_SQRT) {
+            gen_fexpr(n->children[0]);
+            emitln("sqrtsd xmm0, xmm0");
+        } else if (n->ival == TOK_ABS) {
+            gen_fexpr(n->children[0]);
+            emitln("movq rax, xmm0");
+            emitln("btr rax, 63");      // clear the sign bit
+            emitln("movq xmm0, rax");
+        } else {
+            gen_fpair(n->children[0], n->children[1]);
+            emitln(n->ival == TOK_MIN ? "minsd xmm0, xmm1" : "maxsd xmm0, xmm1");
+        }
+        break;
+    case NODE_FN_CALL:
+        gen_expr(n);                    // result already in xmm0
+        break;
+    default:
+        gen_expr(n);                    // fields, array elements — bits in rax
+        emitln("movq xmm0, rax");
+        break;
+    }
+}
+
+// float comparison → 0/1 in rax. ucomisd sets CF/ZF like an unsigned compare
+// and PF for NaN; < and <= swap operands so NaN compares false there too
+static void gen_fcmp(Node *n) {
+    gen_fpair(n->left, n->right);
+    if (strcmp(n->op, "<") == 0 || strcmp(n->op, "<=") == 0) {
+        emitln("ucomisd xmm1, xmm0");
+        emitln(n->op[1] ? "setae al" : "seta al");
+    } else {
+        emitln("ucomisd xmm0, xmm1");
+        if      (strcmp(n->op, ">")  == 0) emitln("seta al");
+        else if (strcmp(n->op, ">=") == 0) emitln("setae al");
+        else if (strcmp(n->op, "==") == 0) {
+            emitln("sete al");
+            emitln("setnp cl");         // unordered (NaN) is never equal
+            emitln("and al, cl");
+        } else {
+            emitln("setne al");
+            emitln("setp cl");
+            emitln("or al, cl");
+        }
+    }
+    emitln("movzx rax, al");
+}
+
+// evaluate e into rax as type dt — float bits for floats, and an int
+// target truncates a float toward zero like int()
+static void gen_as(Node *e, DataType dt) {
+    if (dt == DTYPE_FLOAT) {
+        gen_fexpr(e);
+        emitln("movq rax, xmm0");
+    } else if (expr_dtype(e) == DTYPE_FLOAT) {
+        gen_fexpr(e);
+        emitln("cvttsd2si rax, xmm0");
+    } else {
+        gen_expr(e);
+    }
+}
+
+// two int operands — a → rax, b → rbx
+static void gen_int_pair(Node *a, Node *b) {
+    gen_expr(a);
+    if (!expr_is_leaf(b)) {
+        emitln("push rax");
+        gen_expr(b);
+        emitln("mov rbx, rax");
+        emitln("pop rax");
+    } else {
+        emitln("mov r10, rax");
+        gen_expr(b);
+        emitln("mov rbx, rax");
+        emitln("mov rax, r10");
+    }
+}
+
+// rax <<= / >>= count (arithmetic right shift — ints are signed). like the
+// hardware, the count is taken mod 64
+static void gen_shift(const char *insn, Node *count) {
+    if (count->type != NODE_NUMBER) emitln("mov rcx, rbx");
+    emit(insn);
+    if (count->type == NODE_NUMBER) {
+        buf_write_str(out_buf, &out_cursor, " rax, ");
+        buf_write_int(out_buf, &out_cursor, count->ival & 63);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        return;
+    }
+    buf_write_str(out_buf, &out_cursor, " rax, cl\n");
+}
+
+// ─────────────────────────────────────────
+// Branchless select — cmp + cmovcc
+// both values are computed, then the condition picks one without a jump,
+// so data-dependent choices cost the same whichever way they go
+// ─────────────────────────────────────────
+
+// condition → flags; returns the cc suffix meaning "true"
+static const char *gen_flags(Node *cond) {
+    if (cond->type == NODE_BINOP && is_cmp_op(cond->op) &&
+        expr_dtype(cond->left) != DTYPE_FLOAT && expr_dtype(cond->right) != DTYPE_FLOAT) {
+        gen_int_pair(cond->left, cond->right);
+        emitln("cmp rax, rbx");
+        if (strcmp(cond->op, ">")  == 0) return "g";
+        if (strcmp(cond->op, "<")  == 0) return "l";
+        if (strcmp(cond->op, "==") == 0) return "e";
+        if (strcmp(cond->op, "!=") == 0) return "ne";
+        if (strcmp(cond->op, ">=") == 0) return "ge";
+        return "le";
+    }
+    gen_expr(cond);                     // 0 / 1 (float compares, and / or, ...)
+    emitln("test rax, rax");
+    return "nz";
+}
+
+static const char *cc_invert(const char *cc) {
+    static const char *pairs[][2] = { {"g", "le"}, {"l", "ge"}, {"e", "ne"}, {"nz", "z"} };
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return cc;
+}
+
+// jump to label id when the flags satisfy cc
+static void emit_jcc(const char *cc, int id) {
+    char instr[8] = "j";
+    strncat(instr, cc, 4);
+    emit_jmp(instr, id);
+}
+
+// value that can be loaded with a single mov after the compare — mov leaves
+// the flags alone, so it needs no push/pop around the condition
+static int select_leaf_ok(Node *n, DataType dt) {
+    if (n->type == NODE_NUMBER) return dt != DTYPE_FLOAT;
+    if (n->type != NODE_IDENT || var_dtype(n->name) != dt || dt == DTYPE_BOOL) return 0;
+    if (iv_delta && strcmp(n->name, iv_name) == 0)
+        return regalloc_find(n->name) >= 0;     // lea keeps flags, add doesn't
+    return 1;
+}
+
+static void gen_select_leaf(Node *n, const char *reg) {
+    int r = n->type == NODE_IDENT ? regalloc_find(n->name) : -1;
+    int delta = (n->type == NODE_IDENT && iv_delta && strcmp(n->name, iv_name) == 0) ? iv_delta : 0;
+    emit(delta ? "lea " : "mov ");
+    buf_write_str(out_buf, &out_cursor, reg);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    if (n->type == NODE_NUMBER) {
+        buf_write_int(out_buf, &out_cursor, n->ival);
+    } else if (r >= 0 && var_dtype(n->name) == DTYPE_INT) {
+        if (delta) buf_write_str(out_buf, &out_cursor, "[");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[r]);
+        if (delta) {
+            buf_write_str(out_buf, &out_cursor, "+");
+            buf_write_int(out_buf, &out_cursor, delta);
+            buf_write_str(out_buf, &out_cursor, "]");
+        }
+    } else {
+        write_mem(var_offset(n->name));
+    }
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// rax = cond ? a : b, both evaluated as dt
+static void gen_select(Node *cond, Node *a, Node *b, DataType dt) {
+    int a_leaf = select_leaf_ok(a, dt);
+    int b_leaf = select_leaf_ok(b, dt);
+    if (!a_leaf) { gen_as(a, dt); emitln("push rax"); }
+    if (!b_leaf) { gen_as(b, dt); emitln("push rax"); }
+    const char *cc = gen_flags(cond);
+    if (b_leaf) gen_select_leaf(b, "rax"); else emitln("pop rax");
+    if (a_leaf) gen_select_leaf(a, "rbx"); else emitln("pop rbx");
+    emit("cmov");
+    buf_write_str(out_buf, &out_cursor, cc);
+    buf_write_str(out_buf, &out_cursor, " rax, rbx\n");
+}
+
+// ─────────────────────────────────────────
+// Strings — pointer + length
+// a str value is a view: gen_str leaves the pointer in rax and the byte
+// length in rdx (the SysV pair for a 16-byte struct), so len() is a register
+// move and a slice is two adds. gen_expr of a str still gives the pointer,
+// which is all libc and the syscalls want
+// ─────────────────────────────────────────
+
+// 1 if gen_str gets the length without scanning for the NUL
+static int str_is_fat(Node *n) {
+    switch (n->type) {
+    case NODE_STRING: return 1;
+    case NODE_MAP_FILE: return 1;
+    case NODE_SLICE:  return expr_dtype(n->left) == DTYPE_PTR || str_is_fat(n->left);
+    case NODE_IDENT:  return var_dtype(n->name) == DTYPE_STR;
+    case NODE_FN_CALL: {
+        FnSig *sig = find_fn(n->name);
+        return sig && sig->ret == DTYPE_STR;
+    }
+    case NODE_SELECT:
+        return str_is_fat(n->children[1]) && str_is_fat(n->children[2]);
+    default:
+        return 0;
+    }
+}
+
+// 1 if gen_str(n) falls back to the strlen call — node_has_call must see it
+static int str_needs_scan(Node *n) {
+    return !str_is_fat(n);
+}
+
+// [rbp-off] ← rax, [rbp-off+8] ← rdx
+static void store_str(int off) {
+    emit_mem("mov ", off, ", rax");
+    emit_mem("mov ", off - 8, ", rdx");
+}
+
+// s[a:b] — bounds are clamped to the string, so a view never reads past it.
+// a ptr has no length: buf[a:b] trusts b, and only an inverted range is emptied
+static void gen_slice(Node *n) {
+    int is_ptr = expr_dtype(n->left) == DTYPE_PTR;
+    if (is_ptr && n->child_count < 2) {
+        fprintf(stderr, "Codegen error: slice of ptr '%s' needs an end index\n", n->name);
+        exit(1);
+    }
+    if (is_ptr) {
+        gen_expr(n->left);              // base → rax
+        emitln("push rax");
+    } else {
+        gen_str(n->left);               // base → rax, length → rdx
+        emitln("push rax");
+        emitln("push rdx");
+    }
+    gen_expr(n->children[0]);           // start
+    if (n->child_count > 1) {
+        emitln("push rax");
+        gen_expr(n->children[1]);       // end
+        emitln("mov rcx, rax");
+        emitln("pop rbx");
+    } else {
+        emitln("mov rbx, rax");
+    }
+    if (is_ptr) {
+        emitln("pop rax");
+        emitln("mov rdx, rcx");
+        emitln("xor ecx, ecx");
+        emitln("sub rdx, rbx");         // end - start
+        emitln("cmovl rdx, rcx");       // end < start → empty
+        emitln("add rax, rbx");
+        return;
+    }
+    emitln("pop rdx");
+    emitln("pop rax");
+    if (n->child_count < 2) emitln("mov rcx, rdx");
+    // unsigned compares — a negative bound is huge and clamps too
+    emitln("cmp rcx, rdx");
+    emitln("cmova rcx, rdx");           // end = min(end, len)
+    emitln("cmp rbx, rcx");
+    emitln("cmova rbx, rcx");           // start = min(start, end)
+    emitln("add rax, rbx");
+    emitln("mov rdx, rcx");
+    emitln("sub rdx, rbx");
+}
+
+// str expression → rax = pointer, rdx = length
+static void gen_str(Node *n) {
+    switch (n->type) {
+    case NODE_STRING: {
+        int sid = intern_str(n->sval);
+        emit("lea rax, [rel str");
+        buf_write_int(out_buf, &out_cursor, sid);
+        buf_write_str(out_buf, &out_cursor, "]\n");
+        emit("mov rdx, str");
+        buf_write_int(out_buf, &out_cursor, sid);
+        buf_write_str(out_buf, &out_cursor, "_len\n");
+        return;
+    }
+    case NODE_SLICE:
+        gen_slice(n);
+        return;
+    case NODE_SELECT:
+        if (str_needs_scan(n)) break;
+        gen_str(n->children[1]);
+        emitln("push rax");
+        emitln("push rdx");
+        gen_str(n->children[2]);
+        emitln("push rax");
+        emitln("push rdx");
+        {
+            const char *cc = gen_flags(n->children[0]);
+            emitln("pop rdx");              // b — pops leave the flags alone
+            emitln("pop rax");
+            emitln("pop rcx");              // a
+            emitln("pop rbx");
+            emit("cmov");
+            buf_write_str(out_buf, &out_cursor, cc);
+            buf_write_str(out_buf, &out_cursor, " rax, rbx\n");
+            emit("cmov");
+            buf_write_str(out_buf, &out_cursor, cc);
+            buf_write_str(out_buf, &out_cursor, " rdx, rcx\n");
+        }
+        return;
+    default:
+        if (str_needs_scan(n)) break;
+        if (n->type == NODE_IDENT) {
+            int off = var_offset(n->name);
+            emit_mem("mov rax, ", off, "");
+            emit_mem("mov rdx, ", off - 8, "");
+            return;
+        }
+        gen_expr(n);                    // str function — returns in rax:rdx
+        return;
+    }
+    // C string (struct field, array element, ptr, extern call) — scan once.
+    // rbx is callee-saved, so the pointer survives strlen
+    gen_expr(n);
+    emitln("mov rbx, rax");
+    emitln("mov rdi, rax");
+    emitln("call strlen");
+    emitln("mov rdx, rax");
+    emitln("mov rax, rbx");
+    cse_clear();
+}
 
 static void gen_expr(Node *n) {
+    if (hoist_count && gen_hoisted(n)) return;
+
+    // float arithmetic runs in xmm0 — rax gets the bits for generic code
+    if (n->type == NODE_FLOAT ||
+        ((n->type == NODE_BINOP || n->type == NODE_NEG || n->type == NODE_INTRINSIC) &&
+         expr_dtype(n) == DTYPE_FLOAT)) {
+        gen_fexpr(n);
+        emitln("movq rax, xmm0");
+        n->dtype = DTYPE_FLOAT;
+        return;
+    }
     switch (n->type) {
 
     // ── integer literal ──
@@ -335,7 +1307,16 @@ static void gen_expr(Node *n) {
         n->dtype     = dt;
         // check if variable lives in a register
         int reg = regalloc_find(n->name);
+        int delta = (iv_delta && strcmp(n->name, iv_name) == 0) ? iv_delta : 0;
         if (reg >= 0 && dt == DTYPE_INT) {
+            if (delta) {
+                emit("lea rax, [");
+                buf_write_str(out_buf, &out_cursor, alloc_regs[reg]);
+                buf_write_str(out_buf, &out_cursor, "+");
+                buf_write_int(out_buf, &out_cursor, delta);
+                buf_write_str(out_buf, &out_cursor, "]\n");
+                break;
+            }
             emit("mov rax, ");
             buf_write_str(out_buf, &out_cursor, alloc_regs[reg]);
             buf_write_str(out_buf, &out_cursor, "\n");
@@ -357,19 +1338,19 @@ static void gen_expr(Node *n) {
             emit("mov rax, [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "]\n");
+            if (delta) {
+                emit("add rax, ");
+                buf_write_int(out_buf, &out_cursor, delta);
+                buf_write_str(out_buf, &out_cursor, "\n");
+            }
         }
         break;
     }
 
     // ── string literal ──
     case NODE_STRING: {
-        // record string in str_buf → str0 db "hello", 10, 0
-        int sid = str_count++;
-        buf_write_str(str_buf, &str_cursor, "    str");
-        buf_write_int(str_buf, &str_cursor, sid);
-        buf_write_str(str_buf, &str_cursor, " db \"");
-        buf_write_str(str_buf, &str_cursor, n->sval);
-        buf_write_str(str_buf, &str_cursor, "\", 0\n");
+        // interned → str0 db "hello", 0 in .rodata
+        int sid = intern_str(n->sval);
         // load address into rax
         emit("lea rax, [rel str");
         buf_write_int(out_buf, &out_cursor, sid);
@@ -383,7 +1364,20 @@ static void gen_expr(Node *n) {
     case NODE_ARRAY_ACCESS: {
         int base = var_offset(n->name);
         DataType dt = var_dtype(n->name);
-        if (dt == DTYPE_PTR) {
+        int base_reg = dt == DTYPE_PTR ? hoisted_base(n->name) : -1;
+        int iv_reg, iv_disp;
+        if (iv_lookup(n, &iv_reg, &iv_disp)) {
+            // running pointer (IV strength reduction)
+            emit("mov rax, ");
+            write_iv_mem(iv_reg, iv_disp);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        } else if (base_reg >= 0) {
+            // base already in a register (LICM)
+            gen_expr(n->left);          // index → rax
+            emit("mov rax, [");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[base_reg]);
+            buf_write_str(out_buf, &out_cursor, "+rax*8]\n");
+        } else if (dt == DTYPE_PTR) {
             // pointer indexing: ptr[i] = *(ptr + i*8)
             emit("mov rax, [rbp-");
             buf_write_int(out_buf, &out_cursor, base);
@@ -435,6 +1429,14 @@ static void gen_expr(Node *n) {
 
     // ── binary operation ──
     case NODE_BINOP: {
+        if (expr_dtype(n->left) == DTYPE_FLOAT || expr_dtype(n->right) == DTYPE_FLOAT) {
+            if (!is_cmp_op(n->op)) {
+                fprintf(stderr, "Type error: operator '%s' needs int operands\n", n->op);
+                exit(1);
+            }
+            gen_fcmp(n);
+            break;
+        }
         // CSE — check if both sides are simple idents and we've seen this before
         char lhs[64] = "", rhs[64] = "";
         int use_cse = 0;
@@ -446,38 +1448,35 @@ static void gen_expr(Node *n) {
                 // reuse cached result from r11
                 emitln("mov rax, r11");
                 use_cse = 1;
+                remark(n, "cse", 1, "reused %s %s %s from r11", lhs, n->op, rhs);
             }
         }
         if (!use_cse) {
-            gen_expr(n->left);
-            if (n->right->type == NODE_BINOP || n->right->type == NODE_FN_CALL) {
-                emitln("push rax");
-                gen_expr(n->right);
-                emitln("mov rbx, rax");
-                emitln("pop rax");
-            } else {
-                emitln("mov r10, rax");
-                gen_expr(n->right);
-                emitln("mov rbx, rax");
-                emitln("mov rax, r10");
-            }
+            gen_int_pair(n->left, n->right);
             if      (strcmp(n->op, "+") == 0) emitln("add rax, rbx");
             else if (strcmp(n->op, "-") == 0) emitln("sub rax, rbx");
             else if (strcmp(n->op, "*") == 0) {
                 if (n->right->type == NODE_NUMBER) {
-                    int val = n->right->ival;
-                    if      (val == 2)  emitln("shl rax, 1");
-                    else if (val == 4)  emitln("shl rax, 2");
-                    else if (val == 8)  emitln("shl rax, 3");
-                    else if (val == 16) emitln("shl rax, 4");
-                    else if (val == 32) emitln("shl rax, 5");
-                    else if (val == 64) emitln("shl rax, 6");
-                    else emitln("imul rax, rbx");
+                    int val = n->right->ival, shift = 1;
+                    while (shift < 6 && val != 1 << shift) shift++;    // 2 .. 64
+                    if (val == 1 << shift) {
+                        emit("shl rax, ");
+                        buf_write_int(out_buf, &out_cursor, shift);
+                        buf_write_str(out_buf, &out_cursor, "\n");
+                        remark(n, "strength", 1, "* %d became shl %d", val, shift);
+                    } else {
+                        emitln("imul rax, rbx");
+                    }
                 } else {
                     emitln("imul rax, rbx");
                 }
             }
             else if (strcmp(n->op, "/") == 0) { emitln("xor rdx, rdx"); emitln("idiv rbx"); }
+            else if (strcmp(n->op, "&") == 0) emitln("and rax, rbx");
+            else if (strcmp(n->op, "|") == 0) emitln("or rax, rbx");
+            else if (strcmp(n->op, "^") == 0) emitln("xor rax, rbx");
+            else if (n->op[0] == '<' && n->op[1] == '<') gen_shift("shl", n->right);
+            else if (n->op[0] == '>' && n->op[1] == '>') gen_shift("sar", n->right);
             else emit_cmp(n->op);
             // cache this result in r11 if both sides were simple idents
             if (lhs[0] && rhs[0]) {
@@ -488,21 +1487,69 @@ static void gen_expr(Node *n) {
         break;
     }
 
+    // ── int(x) / float(x) ──
+    case NODE_CAST:
+        gen_as(n->right, n->dtype);
+        break;
+
     // ── function call ──
+    // SysV: int args take rdi, rsi, ... in order, float args xmm0, xmm1, ...
+    // a str parameter of a K function takes two: pointer, then length.
+    // C functions get the bare pointer
     case NODE_FN_CALL: {
         const char *arg_regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+        FnSig *sig = find_fn(n->name);
+        DataType arg_types[64];
+        int slot[64], ints = 0, floats = 0;
         for (int i = 0; i < n->child_count; i++) {
-            gen_expr(n->children[i]);
+            arg_types[i] = (sig && i < sig->param_count) ? sig->param_types[i]
+                                                         : expr_dtype(n->children[i]);
+            if (sig && arg_types[i] == DTYPE_STR) {
+                slot[i] = ints;
+                ints += 2;
+                gen_str(n->children[i]);
+                emitln("push rax");
+                emitln("push rdx");
+                continue;
+            }
+            slot[i] = arg_types[i] == DTYPE_FLOAT ? floats++ : ints++;
+            gen_as(n->children[i], arg_types[i]);
             emitln("push rax");
         }
+        if (ints > 6) {
+            fprintf(stderr, "Codegen error: call to '%s' needs more than 6 int registers\n", n->name);
+            exit(1);
+        }
         for (int i = n->child_count - 1; i >= 0; i--) {
+            if (sig && arg_types[i] == DTYPE_STR) {
+                emit("pop ");
+                buf_write_str(out_buf, &out_cursor, arg_regs[slot[i] + 1]);
+                buf_write_str(out_buf, &out_cursor, "\n");
+            }
+            if (arg_types[i] == DTYPE_FLOAT) {
+                emitln("pop rax");
+                emit("movq xmm");
+                buf_write_int(out_buf, &out_cursor, slot[i]);
+                buf_write_str(out_buf, &out_cursor, ", rax\n");
+                continue;
+            }
             emit("pop ");
-            buf_write_str(out_buf, &out_cursor, arg_regs[i]);
+            buf_write_str(out_buf, &out_cursor, arg_regs[slot[i]]);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        }
+        if (!sig && floats) {
+            emit("mov rax, ");              // al = vector registers used (varargs)
+            buf_write_int(out_buf, &out_cursor, floats);
             buf_write_str(out_buf, &out_cursor, "\n");
         }
         emit("call ");
         buf_write_str(out_buf, &out_cursor, n->name);
         buf_write_str(out_buf, &out_cursor, "\n");
+        cse_clear();
+        if (sig && sig->ret == DTYPE_FLOAT) {
+            emitln("movq rax, xmm0");       // float result in xmm0
+            n->dtype = DTYPE_FLOAT;
+        }
         break;
     }
 
@@ -531,6 +1578,16 @@ static void gen_expr(Node *n) {
     // syscall 9 = mmap(addr=0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)
     case NODE_ALLOC: {
         gen_expr(n->left);              // size → rax
+        if (options.trace_alloc) {
+            emitln("mov rdi, rax");
+            emit("mov rsi, ");
+            buf_write_int(out_buf, &out_cursor, ta_site(n->line));
+            buf_write_str(out_buf, &out_cursor, "\n");
+            emitln("call k_trace_alloc");
+            cse_clear();
+            n->dtype = DTYPE_PTR;
+            break;
+        }
         emitln("mov rdi, 0");           // addr = 0 (kernel chooses)
         emitln("mov rsi, rax");         // size
         emitln("mov rdx, 3");           // PROT_READ | PROT_WRITE
@@ -539,6 +1596,7 @@ static void gen_expr(Node *n) {
         emitln("mov r9, 0");            // offset = 0
         emitln("mov rax, 9");           // syscall 9 = mmap
         emitln("syscall");              // rax = pointer to memory
+        cse_clear();
         n->dtype = DTYPE_PTR;
         break;
     }
@@ -552,6 +1610,7 @@ static void gen_expr(Node *n) {
         emitln("mov rdx, 0");           // mode = 0
         emitln("mov rax, 2");           // syscall 2 = open
         emitln("syscall");              // rax = fd
+        cse_clear();
         n->dtype = DTYPE_INT;
         break;
     }
@@ -592,49 +1651,3467 @@ static void gen_expr(Node *n) {
         break;
     }
 
-    case NODE_NEG:
-        gen_expr(n->right);
-        emitln("neg rax");
-        break;
+    case NODE_NEG:
+        gen_expr(n->right);
+        emitln("neg rax");
+        break;
+
+    case NODE_BITNOT:
+        gen_expr(n->right);
+        emitln("not rax");
+        break;
+
+    case NODE_SELECT: {
+        DataType dt = expr_dtype(n);
+        gen_select(n->children[0], n->children[1], n->children[2], dt);
+        n->dtype = dt;
+        break;
+    }
+
+    // ── intrinsics — one instruction, or a cmov pair for min / max / abs ──
+    // (float forms are handled by gen_fexpr)
+    case NODE_INTRINSIC: {
+        if (n->ival == TOK_MIN || n->ival == TOK_MAX) {
+            gen_int_pair(n->children[0], n->children[1]);
+            emitln("cmp rax, rbx");
+            emitln(n->ival == TOK_MIN ? "cmovg rax, rbx" : "cmovl rax, rbx");
+            break;
+        }
+        gen_expr(n->children[0]);
+        if (n->ival == TOK_ABS) {
+            emitln("mov rbx, rax");
+            emitln("neg rax");
+            emitln("cmovs rax, rbx");   // was positive — keep the original
+            break;
+        }
+        if (expr_dtype(n->children[0]) == DTYPE_FLOAT) {
+            fprintf(stderr, "Type error: %s needs an int argument\n", n->name);
+            exit(1);
+        }
+        if      (n->ival == TOK_POPCNT) emitln("popcnt rax, rax");
+        else if (n->ival == TOK_LZCNT)  emitln("lzcnt rax, rax");
+        else if (n->ival == TOK_TZCNT)  emitln("tzcnt rax, rax");
+        else                            emitln("bswap rax");
+        break;
+    }
+
+    // len(s) / strlen(s) — a str knows its length, only a ptr is scanned
+    case NODE_STRLEN:
+        if (n->right->type == NODE_STRING) {
+            emit("mov rax, str");       // literal — its length is a constant
+            buf_write_int(out_buf, &out_cursor, intern_str(n->right->sval));
+            buf_write_str(out_buf, &out_cursor, "_len\n");
+            break;
+        }
+        gen_str(n->right);              // pointer → rax, length → rdx
+        emitln("mov rax, rdx");
+        break;
+
+    // find / find_byte / count_byte / split_lines — SIMD runtime helpers
+    case NODE_SCAN:
+        gen_scan(n);
+        break;
+
+    // compare(a, b, n) — and copy / fill, which leave nothing useful in rax
+    case NODE_MEMOP:
+        gen_memop(n);
+        break;
+
+    // map_file(path [, advice]) — pointer → rax, length → rdx
+    case NODE_MAP_FILE:
+        gen_map_file(n);
+        break;
+
+    // submit_read / submit_write → ticket, wait_completions → count
+    case NODE_IO:
+        gen_io(n);
+        break;
+
+    // readv / writev / copy_file → bytes moved
+    case NODE_XFER:
+        gen_xfer(n);
+        break;
+
+    // s[a:b] — pointer into s, no copy
+    case NODE_SLICE:
+        gen_str(n);
+        n->dtype = DTYPE_STR;
+        break;
+
+    default:
+        fprintf(stderr, "Codegen error: unexpected node in expression\n");
+        exit(1);
+    }
+}
+
+static void emit_inst_exit(void);
+static int  inst_fn = -1;               // --instrument table row of the current function
+
+static void emit_epilogue() {
+    if (inst_fn >= 0) emit_inst_exit();
+    emitln("mov rsp, rbp");
+    emitln("pop rbp");
+    emitln("ret");
+}
+
+// 1 if any owned allocation is live — those must be freed before the frame dies
+static int has_owned_vars() {
+    for (int i = 0; i < var_count; i++)
+        if (var_table[i].dtype == DTYPE_PTR && var_table[i].owned) return 1;
+    return 0;
+}
+
+// return f(args) — reuse the current frame instead of growing the stack.
+// self-recursion: args overwrite the param slots, jump back to the body.
+// another K function: args go to registers, frame is torn down, jmp to it —
+// callee returns straight to our caller.
+// returns 0 if the call can't be lowered (caller emits a normal call)
+static int gen_tail_call(Node *call) {
+    const char *arg_regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+    if (cur_fn_entry < 0) return 0;
+    FnSig *sig = find_fn(call->name);
+    if (!sig) return 0;
+    const char *why = NULL;
+    int regs = call->child_count;
+    for (int i = 0; i < sig->param_count; i++)
+        if (sig->param_types[i] == DTYPE_STR) regs++;              // pointer + length
+    if (has_owned_vars())                                         why = "owned pointers are freed after it";
+    else if (sig->param_count != call->child_count)               why = "argument count differs";
+    else if (regs > 6)                                            why = "more than 6 arguments";
+    else if (sig->ret != cur_fn_ret)                              why = "return types differ";
+    for (int i = 0; !why && i < sig->param_count; i++)
+        if (sig->param_types[i] == DTYPE_FLOAT) why = "float arguments";    // passed in xmm
+    if (why) {
+        remark(call, "tailcall", 0, "call to %s kept: %s", call->name, why);
+        return 0;
+    }
+    remark(call, "tailcall", 1, "call to %s became a jump", call->name);
+
+    for (int i = 0; i < call->child_count; i++) {
+        if (sig->param_types[i] == DTYPE_STR) {
+            gen_str(call->children[i]);
+            emitln("push rax");
+            emitln("push rdx");
+            continue;
+        }
+        gen_expr(call->children[i]);
+        emitln("push rax");
+    }
+    if (strcmp(call->name, cur_fn) == 0) {
+        for (int i = call->child_count - 1; i >= 0; i--) {
+            int off = param_table[i].offset;
+            if (sig->param_types[i] == DTYPE_STR) {
+                emitln("pop rax");
+                emit_mem("mov ", off - 8, ", rax");
+            }
+            emitln("pop rax");
+            emit_mem("mov ", off, ", rax");
+        }
+        emit_jmp("jmp", cur_fn_entry);
+        return 1;
+    }
+    if (inst_fn >= 0) emit_inst_exit();    // our frame ends here, the callee times itself
+    for (int i = call->child_count - 1; i >= 0; i--) {
+        if (sig->param_types[i] == DTYPE_STR) {
+            emit("pop ");
+            buf_write_str(out_buf, &out_cursor, arg_regs[--regs]);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        }
+        emit("pop ");
+        buf_write_str(out_buf, &out_cursor, arg_regs[--regs]);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+    emitln("mov rsp, rbp");
+    emitln("pop rbp");
+    emit("jmp ");
+    buf_write_str(out_buf, &out_cursor, call->name);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    return 1;
+}
+
+static void emit_auto_free() {
+    for (int i = 0; i < var_count; i++) {
+        if (var_table[i].dtype == DTYPE_PTR && var_table[i].owned) {
+            emit("mov rdi, [rbp-");
+            buf_write_int(out_buf, &out_cursor, var_table[i].offset);
+            buf_write_str(out_buf, &out_cursor, "]\n");
+            if (options.trace_alloc) {
+                emitln("call k_trace_free");
+                cse_clear();
+                continue;
+            }
+            emitln("mov rsi, 1024");    // size — we store this later
+            emitln("mov rax, 11");      // munmap
+            emitln("syscall");
+            cse_clear();
+        }
+    }
+}
+
+
+// returns 1 if node tree references variable name
+static int node_uses_var(Node *n, const char *varname) {
+    if (!n) return 0;
+    if (n->type == NODE_IDENT && strcmp(n->name, varname) == 0) return 1;
+    if (node_uses_var(n->left,  varname)) return 1;
+    if (node_uses_var(n->right, varname)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_uses_var(n->children[i], varname)) return 1;
+    return 0;
+}
+
+// returns 1 if the tree contains a loop — nested loops reuse r14/r15
+static int node_has_loop(Node *n) {
+    if (!n) return 0;
+    if (n->type == NODE_FOR || n->type == NODE_FOR_IF ||
+        n->type == NODE_WHILE || n->type == NODE_DO_WHILE) return 1;
+    if (node_has_loop(n->left) || node_has_loop(n->right)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_has_loop(n->children[i])) return 1;
+    return 0;
+}
+
+// returns 1 if the tree calls out — caller-saved r8/r9 don't survive it
+// (alloc counts: its mmap setup writes r8/r9)
+static int node_has_call(Node *n) {
+    if (!n) return 0;
+    if (n->type == NODE_FN_CALL || n->type == NODE_PRINT ||
+        n->type == NODE_ALLOC   || n->type == NODE_SCAN ||
+        n->type == NODE_MAP_FILE || n->type == NODE_IO ||
+        (n->type == NODE_XFER && n->ival == TOK_COPY_FILE)) return 1;
+    // str values from C strings — gen_str calls strlen for the length
+    if (n->type == NODE_STRLEN && str_needs_scan(n->right)) return 1;
+    if (n->type == NODE_SLICE  && str_needs_scan(n)) return 1;
+    if ((n->type == NODE_ASSIGN || n->type == NODE_REASSIGN) && n->right &&
+        n->right->type != NODE_STRUCT_INIT &&
+        ((n->type == NODE_ASSIGN ? n->dtype : var_dtype(n->name)) == DTYPE_STR ||
+         expr_dtype(n->right) == DTYPE_STR) && str_needs_scan(n->right)) return 1;
+    if (n->type == NODE_WRITE && n->child_count == 2 && str_needs_scan(n->children[1])) return 1;
+    if (n->type == NODE_UNMAP && str_needs_scan(n->left)) return 1;
+    if (n->type == NODE_MEMOP && !memop_inline(n)) return 1;
+    if (node_has_call(n->left) || node_has_call(n->right)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_has_call(n->children[i])) return 1;
+    return 0;
+}
+
+// returns 1 if the tree calls a K function — those reuse r12-r15 freely
+static int node_calls_k_fn(Node *n) {
+    if (!n) return 0;
+    if (n->type == NODE_FN_CALL && find_fn(n->name)) return 1;
+    if (node_calls_k_fn(n->left) || node_calls_k_fn(n->right)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_calls_k_fn(n->children[i])) return 1;
+    return 0;
+}
+
+// returns 1 if the tree assigns to varname (let or plain reassignment)
+static int node_writes_var(Node *n, const char *varname) {
+    if (!n) return 0;
+    if ((n->type == NODE_ASSIGN || n->type == NODE_REASSIGN) &&
+        strcmp(n->name, varname) == 0) return 1;
+    if (node_writes_var(n->left, varname) || node_writes_var(n->right, varname)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_writes_var(n->children[i], varname)) return 1;
+    return 0;
+}
+
+// number of times varname is read in the tree
+static int node_count_uses(Node *n, const char *varname) {
+    if (!n) return 0;
+    int count = (n->type == NODE_IDENT && strcmp(n->name, varname) == 0);
+    count += node_count_uses(n->left,  varname);
+    count += node_count_uses(n->right, varname);
+    for (int i = 0; i < n->child_count; i++)
+        count += node_count_uses(n->children[i], varname);
+    return count;
+}
+
+// structural equality of two expressions
+static int node_equal(Node *a, Node *b) {
+    if (!a || !b) return a == b;
+    if (a->type != b->type) return 0;
+    switch (a->type) {
+    case NODE_NUMBER:
+    case NODE_BOOL:         return a->ival == b->ival;
+    case NODE_FLOAT:        return a->fval == b->fval;
+    case NODE_CAST:         return a->dtype == b->dtype && node_equal(a->right, b->right);
+    case NODE_IDENT:        return strcmp(a->name, b->name) == 0;
+    case NODE_BINOP:        return strcmp(a->op, b->op) == 0 &&
+                                   node_equal(a->left, b->left) && node_equal(a->right, b->right);
+    case NODE_NEG:
+    case NODE_BITNOT:       return node_equal(a->right, b->right);
+    case NODE_INTRINSIC:    return a->ival == b->ival && node_equal(a->children[0], b->children[0]) &&
+                                   (a->child_count < 2 || node_equal(a->children[1], b->children[1]));
+    case NODE_ARRAY_ACCESS: return strcmp(a->name, b->name) == 0 && node_equal(a->left, b->left);
+    case NODE_FIELD_ACCESS: return strcmp(a->name, b->name) == 0 && strcmp(a->sval, b->sval) == 0;
+    default:                return 0;
+    }
+}
+
+// for / for-where latch: counter += step, loop again while counter <= limit.
+// plain loops keep limit/step in r14/r15, nested ones in frame slots
+static void emit_for_latch(int off, int loop_reg, int nested, int lim_off, int step_off,
+                           int lbl_check, int lbl_body) {
+    if (loop_reg >= 0) {
+        emit("add ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+        if (nested) {
+            buf_write_str(out_buf, &out_cursor, ", ");
+            write_mem(step_off);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        } else {
+            buf_write_str(out_buf, &out_cursor, ", r15\n");
+        }
+        emit("mov rax, ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit("mov [rbp-");
+        buf_write_int(out_buf, &out_cursor, off);
+        buf_write_str(out_buf, &out_cursor, "], rax\n");
+    } else {
+        emit("mov rax, [rbp-");
+        buf_write_int(out_buf, &out_cursor, off);
+        buf_write_str(out_buf, &out_cursor, "]\n");
+        if (nested) emit_mem("add rax, ", step_off, "");
+        else        emitln("add rax, r15");
+        emit("mov [rbp-");
+        buf_write_int(out_buf, &out_cursor, off);
+        buf_write_str(out_buf, &out_cursor, "], rax\n");
+    }
+
+    emit_label(lbl_check);
+    emit("mov rax, [rbp-");
+    buf_write_int(out_buf, &out_cursor, off);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    if (nested) emit_mem("cmp rax, ", lim_off, "");
+    else        emitln("cmp rax, r14");
+    emit_jmp("jle", lbl_body);
+}
+
+// ─────────────────────────────────────────
+// Debug info (-g)
+// %line tells nasm which .k line the following asm came from; with
+// -g -F dwarf it becomes .debug_line, so perf annotate and gdb show source
+// ─────────────────────────────────────────
+static int last_line = 0;
+
+static void emit_line(Node *n) {
+    if (!options.debug || !n->line || n->line == last_line) return;
+    last_line = n->line;
+    buf_write_str(out_buf, &out_cursor, "%line ");
+    buf_write_int(out_buf, &out_cursor, n->line);
+    buf_write_str(out_buf, &out_cursor, "+0 ");
+    buf_write_str(out_buf, &out_cursor, options.source_path);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// `global name:function (name.end - name)` — a sized function symbol, so
+// profilers attribute every sample in the body to it. emit_fn_end closes it
+static void emit_fn_global(const char *name) {
+    buf_write_str(out_buf, &out_cursor, "\nglobal ");
+    buf_write_str(out_buf, &out_cursor, name);
+    buf_write_str(out_buf, &out_cursor, ":function (");
+    buf_write_str(out_buf, &out_cursor, name);
+    buf_write_str(out_buf, &out_cursor, ".end - ");
+    buf_write_str(out_buf, &out_cursor, name);
+    buf_write_str(out_buf, &out_cursor, ")\n");
+}
+
+static void emit_fn_end(void) {
+    buf_write_str(out_buf, &out_cursor, ".end:\n");
+}
+
+// ─────────────────────────────────────────
+// Profile-guided optimization
+// every if / elif / else, for loop, function and match case gets counters,
+// numbered in AST order. --profile-generate builds count into prof_counts
+// and write them out at exit; --profile-use numbers the same tree the same
+// way and reads the counts back to steer layout, match lowering and unrolling
+// ─────────────────────────────────────────
+#define MAX_PROF_COUNTERS 4096
+
+static int   prof_n    = 0;                     // counters in this program
+static long *prof_data = NULL;                  // --profile-use counts, NULL = none
+static long  prof_buf[MAX_PROF_COUNTERS];
+
+// counters a node owns: if → executions, then taken; for → entries, iterations
+static int prof_width(Node *n) {
+    switch (n->type) {
+    case NODE_IF: case NODE_FOR: case NODE_FOR_IF:
+        return 2;
+    case NODE_ELIF: case NODE_ELSE: case NODE_FN_DEF: case NODE_MATCH_CASE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void prof_number(Node *n) {
+    if (!n) return;
+    int w = prof_width(n);
+    if (w && prof_n + w <= MAX_PROF_COUNTERS) {
+        n->prof_id = prof_n + 1;
+        prof_n += w;
+    }
+    prof_number(n->left);
+    prof_number(n->right);
+    for (int i = 0; i < n->child_count; i++)
+        prof_number(n->children[i]);
+}
+
+static long prof_count(Node *n, int k) {
+    if (!prof_data || !n->prof_id) return 0;
+    return prof_data[n->prof_id - 1 + k];
+}
+
+// bump counter k of n — instrumented builds only. inc writes the flags, so
+// call it where none are live
+static void emit_prof_inc(Node *n, int k) {
+    if (!options.profile_generate || !n->prof_id) return;
+    emit("inc qword [rel prof_counts+");
+    buf_write_int(out_buf, &out_cursor, (n->prof_id - 1 + k) * 8);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+}
+
+// a profile from a different source has a different counter count — ignore it
+static void prof_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Profile warning: cannot open '%s', compiling without it\n", path);
+        return;
+    }
+    long count = -1;
+    int ok = fscanf(f, "k-profile %ld", &count) == 1 && count == prof_n;
+    for (int i = 0; ok && i < prof_n; i++)
+        ok = fscanf(f, "%ld", &prof_buf[i]) == 1;
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Profile warning: '%s' does not match this program, ignoring it\n", path);
+        return;
+    }
+    prof_data = prof_buf;
+}
+
+// branches taken on fewer than 1 in 20 executions become unlikely, a then
+// branch taken on more than 19 in 20 likely. hints in the source win
+static void prof_apply_hints(Node *n) {
+    if (!n) return;
+    long execs = n->type == NODE_IF ? prof_count(n, 0) : 0;
+    if (execs > 0) {
+        long taken = prof_count(n, 1);
+        if (!n->hint && taken * 20 < execs)      n->hint = -1;
+        if (!n->hint && taken * 20 > execs * 19) n->hint = 1;
+        for (int i = 0; i < n->child_count; i++) {
+            Node *c = n->children[i];
+            if (!c->hint && prof_count(c, 0) * 20 < execs) c->hint = -1;
+        }
+    }
+    prof_apply_hints(n->left);
+    prof_apply_hints(n->right);
+    for (int i = 0; i < n->child_count; i++)
+        prof_apply_hints(n->children[i]);
+}
+
+// k_prof_dump — registered with atexit, writes "k-profile N" then N counts
+static void emit_prof_runtime(void) {
+    int lbl_loop  = new_label();
+    int lbl_close = new_label();
+    int lbl_done  = new_label();
+
+    buf_write_str(str_buf, &str_cursor, "    prof_path db \"");
+    buf_write_str(str_buf, &str_cursor, options.profile_generate);
+    buf_write_str(str_buf, &str_cursor, "\", 0\n");
+    buf_write_str(str_buf, &str_cursor, "    prof_mode db \"w\", 0\n");
+    buf_write_str(str_buf, &str_cursor, "    prof_hdr  db \"k-profile %ld\", 10, 0\n");
+
+    emit_str("\nk_prof_dump:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("sub rsp, 8");                   // keep rsp 16-byte aligned for calls
+    emitln("lea rdi, [rel prof_path]");
+    emitln("lea rsi, [rel prof_mode]");
+    emitln("call fopen");
+    emitln("test rax, rax");
+    emit_jmp("jz", lbl_done);
+    emitln("mov r12, rax");                 // FILE *
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel prof_hdr]");
+    emit("mov rdx, ");
+    buf_write_int(out_buf, &out_cursor, prof_n);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("xor rbx, rbx");                 // counter index
+    emit_label(lbl_loop);
+    emit("cmp rbx, ");
+    buf_write_int(out_buf, &out_cursor, prof_n);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("jae", lbl_close);
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel fmt]");
+    emitln("lea rax, [rel prof_counts]");
+    emitln("mov rdx, [rax+rbx*8]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("inc rbx");
+    emit_jmp("jmp", lbl_loop);
+    emit_label(lbl_close);
+    emitln("mov rdi, r12");
+    emitln("call fclose");
+    emit_label(lbl_done);
+    emitln("add rsp, 8");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+}
+
+// ─────────────────────────────────────────
+// Call instrumentation
+// --instrument: every function (and main) counts its calls and reads the
+// TSC on entry and exit. inclusive cycles cover callees, exclusive cycles
+// subtract what the callees reported through inst_child. recursion counts
+// the inner frames' time again in the outer ones' inclusive column.
+// at exit the rows are sorted by exclusive cycles and printed
+// ─────────────────────────────────────────
+#define INST_ROW 32                     // self, total, calls, name — 4 qwords
+static int inst_slot = 0;               // [rbp-slot] caller's inst_child, [rbp-slot+8] entry TSC
+
+// instr [inst_table + row.field] suffix
+static void emit_inst_field(const char *instr, int row, int field, const char *suffix) {
+    emit(instr);
+    buf_write_str(out_buf, &out_cursor, "[rel inst_table+");
+    buf_write_int(out_buf, &out_cursor, row * INST_ROW + field * 8);
+    buf_write_str(out_buf, &out_cursor, "]");
+    buf_write_str(out_buf, &out_cursor, suffix);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+static void emit_rdtsc(void) {
+    emitln("rdtsc");
+    emitln("shl rdx, 32");
+    emitln("or rax, rdx");                  // TSC → rax
+}
+
+// after the params are spilled — rdtsc writes rdx
+static void emit_inst_enter(void) {
+    emit_rdtsc();
+    emit_mem("mov ", inst_slot - 8, ", rax");
+    emitln("mov rax, [rel inst_child]");
+    emit_mem("mov ", inst_slot, ", rax");
+    emitln("mov qword [rel inst_child], 0");
+}
+
+// once per call — self tail calls re-enter below the TSC read and count again
+static void emit_inst_call(void) {
+    if (inst_fn >= 0) emit_inst_field("inc qword ", inst_fn, 2, "");
+}
+
+// before every epilogue — rax / rdx may hold the return value, xmm0 is untouched
+static void emit_inst_exit(void) {
+    emitln("push rax");
+    emitln("push rdx");
+    emit_rdtsc();
+    emit_mem("sub rax, ", inst_slot - 8, "");   // total
+    emit_inst_field("add ", inst_fn, 1, ", rax");
+    emitln("mov rcx, rax");
+    emitln("sub rcx, [rel inst_child]");        // self
+    emit_inst_field("add ", inst_fn, 0, ", rcx");
+    emit_mem("add rax, ", inst_slot, "");
+    emitln("mov [rel inst_child], rax");        // caller's callees += us
+    emitln("pop rdx");
+    emitln("pop rax");
+}
+
+// qsort comparator on a row's first qword, largest first
+static void emit_desc_cmp(const char *name) {
+    emit_str("\n");
+    emit_str(name);
+    emit_str(":\n");
+    emitln("xor eax, eax");
+    emitln("xor edx, edx");
+    emitln("mov rcx, [rsi]");
+    emitln("cmp rcx, [rdi]");
+    emitln("setg al");
+    emitln("setl dl");
+    emitln("sub eax, edx");
+    emitln("ret");
+}
+
+// k_inst_cmp — qsort order, exclusive cycles descending
+// k_inst_dump — registered with atexit, prints every called row
+static void emit_inst_runtime(int rows) {
+    int lbl_open  = new_label();
+    int lbl_loop  = new_label();
+    int lbl_next  = new_label();
+    int lbl_close = new_label();
+    int lbl_done  = new_label();
+    int to_file   = options.instrument[0] != 0;
+
+    if (to_file) {
+        buf_write_str(str_buf, &str_cursor, "    inst_path db \"");
+        buf_write_str(str_buf, &str_cursor, options.instrument);
+        buf_write_str(str_buf, &str_cursor, "\", 0\n");
+        buf_write_str(str_buf, &str_cursor, "    inst_mode db \"w\", 0\n");
+    }
+    buf_write_str(str_buf, &str_cursor,
+        "    inst_hdr  db \"%14s %18s %18s  %s\", 10, 0\n"
+        "    inst_h1   db \"calls\", 0\n"
+        "    inst_h2   db \"self cycles\", 0\n"
+        "    inst_h3   db \"total cycles\", 0\n"
+        "    inst_h4   db \"function\", 0\n"
+        "    inst_row  db \"%14ld %18ld %18ld  %s\", 10, 0\n");
+
+    emit_desc_cmp("k_inst_cmp");
+
+    emit_str("\nk_inst_dump:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("sub rsp, 8");                   // keep rsp 16-byte aligned for calls
+    emitln("lea rdi, [rel inst_table]");
+    emit("mov rsi, ");
+    buf_write_int(out_buf, &out_cursor, rows);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit("mov rdx, ");
+    buf_write_int(out_buf, &out_cursor, INST_ROW);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("lea rcx, [rel k_inst_cmp]");
+    emitln("call qsort");
+    if (to_file) {
+        emitln("lea rdi, [rel inst_path]");
+        emitln("lea rsi, [rel inst_mode]");
+        emitln("call fopen");
+        emitln("test rax, rax");
+        emit_jmp("jz", lbl_done);
+        emitln("mov r12, rax");             // FILE *
+        emit_jmp("jmp", lbl_open);
+    }
+    emitln("mov r12, [rel stderr]");
+    emit_label(lbl_open);
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel inst_hdr]");
+    emitln("lea rdx, [rel inst_h1]");
+    emitln("lea rcx, [rel inst_h2]");
+    emitln("lea r8, [rel inst_h3]");
+    emitln("lea r9, [rel inst_h4]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("lea rbx, [rel inst_table]");    // row pointer
+    emit_label(lbl_loop);
+    emit("lea rax, [rel inst_table+");
+    buf_write_int(out_buf, &out_cursor, rows * INST_ROW);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emitln("cmp rbx, rax");
+    emit_jmp("jae", lbl_close);
+    emitln("mov rdx, [rbx+16]");            // calls
+    emitln("test rdx, rdx");
+    emit_jmp("jz", lbl_next);               // never called — leave it out
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel inst_row]");
+    emitln("mov rcx, [rbx]");               // self
+    emitln("mov r8, [rbx+8]");              // total
+    emitln("mov r9, [rbx+24]");             // name
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emit_label(lbl_next);
+    emitln("add rbx, 32");
+    emit_jmp("jmp", lbl_loop);
+    emit_label(lbl_close);
+    if (to_file) {
+        emitln("mov rdi, r12");
+        emitln("call fclose");
+    }
+    emit_label(lbl_done);
+    emitln("add rsp, 8");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+
+    // one row per function, main last — names are filled in, counts start at 0
+    buf_write_str(str_buf, &str_cursor, "    inst_child dq 0\n    inst_table:\n");
+    for (int i = 0; i < rows; i++) {
+        stream_check();
+        buf_write_str(str_buf, &str_cursor, "    dq 0, 0, 0, inst_name");
+        buf_write_int(str_buf, &str_cursor, i);
+        buf_write_str(str_buf, &str_cursor, "\n");
+    }
+    for (int i = 0; i < rows; i++) {
+        stream_check();
+        buf_write_str(str_buf, &str_cursor, "    inst_name");
+        buf_write_int(str_buf, &str_cursor, i);
+        buf_write_str(str_buf, &str_cursor, " db \"");
+        buf_write_str(str_buf, &str_cursor, i < fn_count ? fn_table[i].name : "main");
+        buf_write_str(str_buf, &str_cursor, "\", 0\n");
+    }
+}
+
+// ─────────────────────────────────────────
+// Allocation tracing
+// --trace-alloc: alloc / free call k_trace_alloc / k_trace_free. each block
+// carries a 32-byte header (size, site, TSC at alloc) in front of the
+// pointer K sees, so free knows the real size and the block's lifetime.
+// sites are source lines; every event also lands in a ring buffer.
+// at exit the heap totals and the top sites by bytes are printed — with
+// --trace-alloc=file the ring's events are written before them
+// ─────────────────────────────────────────
+#define TA_HEADER    32
+#define TA_ROW       40                 // bytes, allocs, frees, lifetime sum, line
+#define TA_RING      4096               // events kept, power of two
+#define TA_TOP       10                 // sites in the summary
+#define MAX_TA_SITES 1024
+
+static int ta_lines[MAX_TA_SITES];
+static int ta_site_count = 0;
+
+// site row for an alloc on this line — unrolled or tiled copies share it
+static int ta_site(int line) {
+    for (int i = 0; i < ta_site_count; i++)
+        if (ta_lines[i] == line) return i;
+    if (ta_site_count == MAX_TA_SITES) return MAX_TA_SITES - 1;
+    ta_lines[ta_site_count] = line;
+    return ta_site_count++;
+}
+
+// append r11 = ±line, rsi = pointer, rdi = size, r10 = TSC or lifetime
+static void emit_ta_record(void) {
+    emitln("mov rax, [rel ta_ring_n]");
+    emitln("inc qword [rel ta_ring_n]");
+    emit("and rax, ");
+    buf_write_int(out_buf, &out_cursor, TA_RING - 1);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("shl rax, 5");
+    emitln("lea rcx, [rel ta_ring]");
+    emitln("add rcx, rax");
+    emitln("mov [rcx], r11");
+    emitln("mov [rcx+8], rsi");
+    emitln("mov [rcx+16], rdi");
+    emitln("mov [rcx+24], r10");
+}
+
+// rcx = &ta_sites[reg]
+static void emit_ta_row(const char *reg) {
+    emit("imul rcx, ");
+    buf_write_str(out_buf, &out_cursor, reg);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    buf_write_int(out_buf, &out_cursor, TA_ROW);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("lea rax, [rel ta_sites]");
+    emitln("add rcx, rax");
+}
+
+// k_trace_alloc(size, site) → pointer past the header, or the mmap error
+// k_trace_free(ptr) — keeps rdx, r8, r9 and r12-r15 like the bare munmap
+static void emit_ta_helpers(void) {
+    int lbl_fail = new_label();
+    int lbl_peak = new_label();
+    int lbl_skip = new_label();
+
+    emit_str("\nk_trace_alloc:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("push r13");
+    emitln("mov r12, rdi");                 // size
+    emitln("mov r13, rsi");                 // site
+    emit("lea rsi, [rdi+");
+    buf_write_int(out_buf, &out_cursor, TA_HEADER);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emitln("xor rdi, rdi");
+    emitln("mov rdx, 3");                   // PROT_READ | PROT_WRITE
+    emitln("mov r10, 34");                  // MAP_PRIVATE | MAP_ANONYMOUS
+    emitln("mov r8, -1");
+    emitln("xor r9, r9");
+    emitln("mov rax, 9");                   // mmap
+    emitln("syscall");
+    emitln("cmp rax, -4096");
+    emit_jmp("ja", lbl_fail);               // -errno — hand it back untouched
+    emitln("mov rbx, rax");
+    emitln("inc qword [rel ta_mmaps]");
+    emitln("mov [rbx], r12");
+    emitln("mov [rbx+8], r13");
+    emit_rdtsc();
+    emitln("mov [rbx+16], rax");
+    emitln("mov r10, rax");
+    emit_ta_row("r13");
+    emitln("add [rcx], r12");
+    emitln("inc qword [rcx+8]");
+    emitln("mov r11, [rcx+32]");            // line
+    emitln("add [rel ta_live_bytes], r12");
+    emitln("inc qword [rel ta_live_count]");
+    emitln("mov rax, [rel ta_live_bytes]");
+    emitln("cmp rax, [rel ta_peak]");
+    emit_jmp("jbe", lbl_peak);
+    emitln("mov [rel ta_peak], rax");
+    emit_label(lbl_peak);
+    emit("lea rsi, [rbx+");
+    buf_write_int(out_buf, &out_cursor, TA_HEADER);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emitln("mov rdi, r12");
+    emit_ta_record();
+    emitln("mov rax, rsi");
+    emit_label(lbl_fail);
+    emitln("pop r13");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+
+    emit_str("\nk_trace_free:\n");
+    emitln("push rdx");
+    emitln("push rbx");
+    emitln("test rdi, rdi");
+    emit_jmp("jz", lbl_skip);
+    emitln("cmp rdi, -4096");
+    emit_jmp("ja", lbl_skip);               // failed alloc — nothing to unmap
+    emit("lea rbx, [rdi-");
+    buf_write_int(out_buf, &out_cursor, TA_HEADER);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emitln("mov rsi, rdi");
+    emitln("mov rdi, [rbx]");               // size from the header
+    emitln("inc qword [rel ta_munmaps]");
+    emitln("sub [rel ta_live_bytes], rdi");
+    emitln("dec qword [rel ta_live_count]");
+    emit_rdtsc();
+    emitln("sub rax, [rbx+16]");
+    emitln("mov r10, rax");                 // lifetime
+    emitln("mov rax, [rbx+8]");
+    emit_ta_row("rax");
+    emitln("inc qword [rcx+16]");
+    emitln("add [rcx+24], r10");
+    emitln("mov r11, [rcx+32]");
+    emitln("neg r11");                      // negative line = free
+    emit_ta_record();
+    emitln("mov rsi, rdi");
+    emit("add rsi, ");
+    buf_write_int(out_buf, &out_cursor, TA_HEADER);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("mov rdi, rbx");
+    emitln("mov rax, 11");                  // munmap
+    emitln("syscall");
+    emit_label(lbl_skip);
+    emitln("pop rbx");
+    emitln("pop rdx");
+    emitln("ret");
+}
+
+// k_trace_dump — registered with atexit
+static void emit_ta_runtime(void) {
+    int lbl_ev    = new_label();
+    int lbl_free  = new_label();
+    int lbl_evnxt = new_label();
+    int lbl_sum   = new_label();
+    int lbl_row   = new_label();
+    int lbl_avg   = new_label();
+    int lbl_close = new_label();
+    int lbl_done  = new_label();
+    int to_file   = options.trace_alloc[0] != 0;
+    int top       = ta_site_count < TA_TOP ? ta_site_count : TA_TOP;
+
+    emit_ta_helpers();
+
+    if (to_file) {
+        buf_write_str(str_buf, &str_cursor, "    ta_path db \"");
+        buf_write_str(str_buf, &str_cursor, options.trace_alloc);
+        buf_write_str(str_buf, &str_cursor, "\", 0\n");
+        buf_write_str(str_buf, &str_cursor, "    ta_mode db \"w\", 0\n");
+        buf_write_str(str_buf, &str_cursor,
+            "    ta_ev_alloc db \"alloc line %ld size %ld ptr %#lx\", 10, 0\n"
+            "    ta_ev_free  db \"free  line %ld size %ld ptr %#lx lifetime %ld\", 10, 0\n");
+    }
+    buf_write_str(str_buf, &str_cursor,
+        "    ta_hdr1 db \"alloc trace: %ld mmap, %ld munmap, peak %ld bytes\", 10, 0\n"
+        "    ta_hdr2 db \"at exit: %ld live allocations, %ld bytes\", 10, 0\n"
+        "    ta_cols db \"         bytes     allocs      frees   avg lifetime  site\", 10, 0\n"
+        "    ta_rowf db \"%14ld %10ld %10ld %14ld  line %ld\", 10, 0\n");
+
+    emit_desc_cmp("k_trace_cmp");
+
+    emit_str("\nk_trace_dump:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("push r13");                     // three pushes keep rsp 16-byte aligned
+    if (to_file) {
+        emitln("lea rdi, [rel ta_path]");
+        emitln("lea rsi, [rel ta_mode]");
+        emitln("call fopen");
+        emitln("test rax, rax");
+        emit_jmp("jz", lbl_done);
+        emitln("mov r12, rax");             // FILE *
+
+        // oldest surviving event first
+        emitln("xor rbx, rbx");
+        emitln("mov rax, [rel ta_ring_n]");
+        emit("sub rax, ");
+        buf_write_int(out_buf, &out_cursor, TA_RING);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emitln("cmovg rbx, rax");
+        emit_label(lbl_ev);
+        emitln("cmp rbx, [rel ta_ring_n]");
+        emit_jmp("jae", lbl_sum);
+        emitln("mov rax, rbx");
+        emit("and rax, ");
+        buf_write_int(out_buf, &out_cursor, TA_RING - 1);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emitln("shl rax, 5");
+        emitln("lea r13, [rel ta_ring]");
+        emitln("add r13, rax");
+        emitln("mov rdi, r12");
+        emitln("mov rdx, [r13]");
+        emitln("mov rcx, [r13+16]");        // size
+        emitln("mov r8, [r13+8]");          // ptr
+        emitln("test rdx, rdx");
+        emit_jmp("js", lbl_free);
+        emitln("lea rsi, [rel ta_ev_alloc]");
+        emit_jmp("jmp", lbl_evnxt);
+        emit_label(lbl_free);
+        emitln("neg rdx");
+        emitln("mov r9, [r13+24]");         // lifetime
+        emitln("lea rsi, [rel ta_ev_free]");
+        emit_label(lbl_evnxt);
+        emitln("xor rax, rax");
+        emitln("call fprintf");
+        emitln("inc rbx");
+        emit_jmp("jmp", lbl_ev);
+    } else {
+        emitln("mov r12, [rel stderr]");
+    }
+    emit_label(lbl_sum);
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel ta_hdr1]");
+    emitln("mov rdx, [rel ta_mmaps]");
+    emitln("mov rcx, [rel ta_munmaps]");
+    emitln("mov r8, [rel ta_peak]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel ta_hdr2]");
+    emitln("mov rdx, [rel ta_live_count]");
+    emitln("mov rcx, [rel ta_live_bytes]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel ta_cols]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+
+    emitln("lea rdi, [rel ta_sites]");
+    emit("mov rsi, ");
+    buf_write_int(out_buf, &out_cursor, ta_site_count);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit("mov rdx, ");
+    buf_write_int(out_buf, &out_cursor, TA_ROW);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("lea rcx, [rel k_trace_cmp]");
+    emitln("call qsort");
+    emitln("xor rbx, rbx");                 // row index
+    emit_label(lbl_row);
+    emit("cmp rbx, ");
+    buf_write_int(out_buf, &out_cursor, top);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("jae", lbl_close);
+    emit_ta_row("rbx");
+    emitln("mov r13, rcx");
+    emitln("cmp qword [r13+8], 0");
+    emit_jmp("je", lbl_close);              // sorted — the rest never allocated
+    emitln("xor rax, rax");
+    emitln("mov rcx, [r13+16]");
+    emitln("test rcx, rcx");
+    emit_jmp("jz", lbl_avg);
+    emitln("mov rax, [r13+24]");
+    emitln("xor rdx, rdx");
+    emitln("div rcx");                      // mean lifetime of the freed blocks
+    emit_label(lbl_avg);
+    emitln("sub rsp, 16");
+    emitln("mov rdx, [r13+32]");
+    emitln("mov [rsp], rdx");               // fifth vararg: line
+    emitln("mov r9, rax");
+    emitln("mov rdi, r12");
+    emitln("lea rsi, [rel ta_rowf]");
+    emitln("mov rdx, [r13]");
+    emitln("mov rcx, [r13+8]");
+    emitln("mov r8, [r13+16]");
+    emitln("xor rax, rax");
+    emitln("call fprintf");
+    emitln("add rsp, 16");
+    emitln("inc rbx");
+    emit_jmp("jmp", lbl_row);
+    emit_label(lbl_close);
+    if (to_file) {
+        emitln("mov rdi, r12");
+        emitln("call fclose");
+    }
+    emit_label(lbl_done);
+    emitln("pop r13");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+
+    buf_write_str(str_buf, &str_cursor,
+        "    ta_mmaps      dq 0\n"
+        "    ta_munmaps    dq 0\n"
+        "    ta_live_bytes dq 0\n"
+        "    ta_live_count dq 0\n"
+        "    ta_peak       dq 0\n"
+        "    ta_ring_n     dq 0\n"
+        "    ta_sites:\n");
+    for (int i = 0; i < ta_site_count; i++) {
+        stream_check();
+        buf_write_str(str_buf, &str_cursor, "    dq 0, 0, 0, 0, ");
+        buf_write_int(str_buf, &str_cursor, ta_lines[i]);
+        buf_write_str(str_buf, &str_cursor, "\n");
+    }
+}
+
+// ─────────────────────────────────────────
+// Byte scanning
+// find / find_byte / count_byte / split_lines call k_* helpers emitted into
+// the program, so no libc is involved. each compares a whole vector of bytes
+// at once — 32 with AVX2, 16 with SSE2 when the compiling machine lacks it —
+// and turns the result into a bit mask with pmovmskb. the bytes after the
+// last full vector go through a scalar tail, so no load crosses the end
+// ─────────────────────────────────────────
+static int scan_used = 0;               // 1 << (TOK_ - TOK_FIND) per helper called
+static int scan_w    = 0;               // vector bytes, 0 = not chosen yet
+
+static int scan_avx2(void) {
+    if (!scan_w) scan_w = __builtin_cpu_supports("avx2") ? 32 : 16;
+    return scan_w == 32;
+}
+
+// vN — ymmN or xmmN
+static void write_vreg(int v) {
+    buf_write_str(out_buf, &out_cursor, scan_avx2() ? "ymm" : "xmm");
+    buf_write_int(out_buf, &out_cursor, v);
+}
+
+// every byte of vector v = low byte of the 32-bit register r
+static void emit_vbcast(int v, const char *r) {
+    if (scan_avx2()) {
+        emit("vmovd xmm");
+        buf_write_int(out_buf, &out_cursor, v);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        buf_write_str(out_buf, &out_cursor, r);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit("vpbroadcastb ");
+        write_vreg(v);
+        buf_write_str(out_buf, &out_cursor, ", xmm");
+        buf_write_int(out_buf, &out_cursor, v);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        return;
+    }
+    const char *steps[] = {"punpcklbw ", "punpcklwd "};
+    emit("movd ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    buf_write_str(out_buf, &out_cursor, r);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    for (int i = 0; i < 2; i++) {
+        emit(steps[i]);
+        write_vreg(v);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        write_vreg(v);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+    emit("pshufd ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, ", 0\n");
+}
+
+// vector d = bytes at [mem] == bytes of vector b (0xff / 0x00 each)
+static void emit_vcmpeq(int d, const char *mem, int b) {
+    if (scan_avx2()) {
+        emit("vpcmpeqb ");
+        write_vreg(d);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        write_vreg(b);
+        buf_write_str(out_buf, &out_cursor, ", [");
+        buf_write_str(out_buf, &out_cursor, mem);
+        buf_write_str(out_buf, &out_cursor, "]\n");
+        return;
+    }
+    emit("movdqu ");                    // pcmpeqb would want it aligned
+    write_vreg(d);
+    buf_write_str(out_buf, &out_cursor, ", [");
+    buf_write_str(out_buf, &out_cursor, mem);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emit("pcmpeqb ");
+    write_vreg(d);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    write_vreg(b);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// vector d &= vector s
+static void emit_vand(int d, int s) {
+    emit(scan_avx2() ? "vpand " : "pand ");
+    write_vreg(d);
+    if (scan_avx2()) {
+        buf_write_str(out_buf, &out_cursor, ", ");
+        write_vreg(d);
+    }
+    buf_write_str(out_buf, &out_cursor, ", ");
+    write_vreg(s);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// 32-bit register r = top bit of each byte of vector v
+static void emit_vmask(const char *r, int v) {
+    emit(scan_avx2() ? "vpmovmskb " : "pmovmskb ");
+    buf_write_str(out_buf, &out_cursor, r);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// ret — leaving the upper ymm halves dirty slows later SSE code
+static void emit_vret(void) {
+    if (scan_avx2()) emitln("vzeroupper");
+    emitln("ret");
+}
+
+// next = reg + vector bytes, to label if that passes bound — no full vector left
+static void emit_vblock_check(const char *next, const char *reg, const char *bound, int lbl) {
+    emit("lea ");
+    buf_write_str(out_buf, &out_cursor, next);
+    buf_write_str(out_buf, &out_cursor, ", [");
+    buf_write_str(out_buf, &out_cursor, reg);
+    buf_write_str(out_buf, &out_cursor, "+");
+    buf_write_int(out_buf, &out_cursor, scan_w);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emit("cmp ");
+    buf_write_str(out_buf, &out_cursor, next);
+    buf_write_str(out_buf, &out_cursor, ", ");
+    buf_write_str(out_buf, &out_cursor, bound);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("ja", lbl);
+}
+
+// k_find_byte(ptr, len, byte) → index of the first match, or -1
+static void emit_find_byte(void) {
+    int lbl_blk  = new_label();
+    int lbl_hit  = new_label();
+    int lbl_tail = new_label();
+    int lbl_none = new_label();
+    int lbl_done = new_label();
+
+    emit_str("\nalign 16\nk_find_byte:\n");
+    emitln("xor eax, eax");
+    emit_vbcast(0, "edx");
+    emit_label(lbl_blk);
+    emit_vblock_check("rcx", "rax", "rsi", lbl_tail);
+    emit_vcmpeq(1, "rdi+rax", 0);
+    emit_vmask("ecx", 1);
+    emitln("test ecx, ecx");
+    emit_jmp("jnz", lbl_hit);
+    emit("add rax, ");
+    buf_write_int(out_buf, &out_cursor, scan_w);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("jmp", lbl_blk);
+    emit_label(lbl_hit);
+    emitln("bsf ecx, ecx");             // lowest set bit = first match
+    emitln("add rax, rcx");
+    emit_jmp("jmp", lbl_done);
+    emit_label(lbl_tail);
+    emitln("cmp rax, rsi");
+    emit_jmp("jae", lbl_none);
+    emitln("cmp [rdi+rax], dl");
+    emit_jmp("je", lbl_done);
+    emitln("inc rax");
+    emit_jmp("jmp", lbl_tail);
+    emit_label(lbl_none);
+    emitln("mov rax, -1");
+    emit_label(lbl_done);
+    emit_vret();
+}
+
+// k_count_byte(ptr, len, byte) → number of matches
+static void emit_count_byte(void) {
+    int lbl_blk  = new_label();
+    int lbl_tail = new_label();
+    int lbl_done = new_label();
+
+    emit_str("\nalign 16\nk_count_byte:\n");
+    emitln("xor eax, eax");             // count
+    emitln("xor r8d, r8d");             // index
+    emit_vbcast(0, "edx");
+    emit_label(lbl_blk);
+    emit_vblock_check("r9", "r8", "rsi", lbl_tail);
+    emit_vcmpeq(1, "rdi+r8", 0);
+    emit_vmask("ecx", 1);
+    emitln("popcnt ecx, ecx");
+    emitln("add rax, rcx");
+    emitln("mov r8, r9");
+    emit_jmp("jmp", lbl_blk);
+    emit_label(lbl_tail);
+    emitln("cmp r8, rsi");
+    emit_jmp("jae", lbl_done);
+    emitln("cmp [rdi+r8], dl");
+    emitln("sete cl");
+    emitln("movzx ecx, cl");
+    emitln("add rax, rcx");
+    emitln("inc r8");
+    emit_jmp("jmp", lbl_tail);
+    emit_label(lbl_done);
+    emit_vret();
+}
+
+// k_split_lines(ptr, len, ends, max) → lines found, at most max. ends[i] is
+// the offset of line i's newline, or len for a last line without one
+static void emit_split_lines(void) {
+    int lbl_blk   = new_label();
+    int lbl_bit   = new_label();
+    int lbl_next  = new_label();
+    int lbl_tail  = new_label();
+    int lbl_tnext = new_label();
+    int lbl_last  = new_label();
+    int lbl_done  = new_label();
+
+    emit_str("\nalign 16\nk_split_lines:\n");
+    emitln("xor eax, eax");             // lines
+    emitln("xor r8d, r8d");             // index
+    emitln("mov r10d, 10");             // '\n'
+    emit_vbcast(0, "r10d");
+    emit_label(lbl_blk);
+    emit_vblock_check("r9", "r8", "rsi", lbl_tail);
+    emit_vcmpeq(1, "rdi+r8", 0);
+    emit_vmask("r11d", 1);
+    emit_label(lbl_bit);
+    emitln("test r11d, r11d");
+    emit_jmp("jz", lbl_next);
+    emitln("cmp rax, rcx");
+    emit_jmp("jae", lbl_done);          // ends is full
+    emitln("bsf r10d, r11d");
+    emitln("add r10, r8");
+    emitln("mov [rdx+rax*8], r10");
+    emitln("inc rax");
+    emitln("lea r10d, [r11-1]");        // clear the lowest set bit
+    emitln("and r11d, r10d");
+    emit_jmp("jmp", lbl_bit);
+    emit_label(lbl_next);
+    emitln("mov r8, r9");
+    emit_jmp("jmp", lbl_blk);
+    emit_label(lbl_tail);
+    emitln("cmp r8, rsi");
+    emit_jmp("jae", lbl_last);
+    emitln("cmp byte [rdi+r8], 10");
+    emit_jmp("jne", lbl_tnext);
+    emitln("cmp rax, rcx");
+    emit_jmp("jae", lbl_done);
+    emitln("mov [rdx+rax*8], r8");
+    emitln("inc rax");
+    emit_label(lbl_tnext);
+    emitln("inc r8");
+    emit_jmp("jmp", lbl_tail);
+    emit_label(lbl_last);
+    emitln("test rsi, rsi");
+    emit_jmp("jz", lbl_done);           // no bytes, no lines
+    emitln("cmp byte [rdi+rsi-1], 10");
+    emit_jmp("je", lbl_done);           // last line has its newline
+    emitln("cmp rax, rcx");
+    emit_jmp("jae", lbl_done);
+    emitln("mov [rdx+rax*8], rsi");
+    emitln("inc rax");
+    emit_label(lbl_done);
+    emit_vret();
+}
+
+// k_find(hay, hay_len, needle, needle_len) → offset of the first match, or -1.
+// a vector of candidates is kept only where both the needle's first and last
+// bytes line up; each survivor is then checked byte by byte
+static void emit_find(void) {
+    int lbl_blk   = new_label();
+    int lbl_bit   = new_label();
+    int lbl_next  = new_label();
+    int lbl_tail  = new_label();
+    int lbl_tnext = new_label();
+    int lbl_eq    = new_label();
+    int lbl_eql   = new_label();
+    int lbl_eqok  = new_label();
+    int lbl_eqret = new_label();
+    int lbl_none  = new_label();
+    int lbl_found = new_label();
+    int lbl_ret   = new_label();
+
+    emit_str("\nalign 16\nk_find:\n");
+    emitln("xor eax, eax");
+    emitln("test rcx, rcx");
+    emit_jmp("jz", lbl_ret);            // "" is found at 0
+    emitln("mov rax, -1");
+    emitln("cmp rcx, rsi");
+    emit_jmp("ja", lbl_ret);            // needle longer than the haystack
+    emitln("push rbx");
+    emitln("mov r8, rsi");
+    emitln("sub r8, rcx");
+    emitln("inc r8");                   // start offsets to try
+    emitln("lea r11, [rdi+rcx-1]");     // hay + needle_len - 1
+    emitln("movzx ebx, byte [rdx]");
+    emit_vbcast(0, "ebx");              // first byte
+    emitln("movzx ebx, byte [rdx+rcx-1]");
+    emit_vbcast(1, "ebx");              // last byte
+    emitln("xor eax, eax");
+    emit_label(lbl_blk);
+    emit_vblock_check("r9", "rax", "r8", lbl_tail);
+    emit_vcmpeq(2, "rdi+rax", 0);
+    emit_vcmpeq(3, "r11+rax", 1);
+    emit_vand(2, 3);
+    emit_vmask("r10d", 2);
+    emit_label(lbl_bit);
+    emitln("test r10d, r10d");
+    emit_jmp("jz", lbl_next);
+    emitln("bsf esi, r10d");
+    emitln("add rsi, rax");
+    emit_jmp("call", lbl_eq);
+    emit_jmp("je", lbl_found);
+    emitln("lea ebx, [r10-1]");         // clear the lowest set bit
+    emitln("and r10d, ebx");
+    emit_jmp("jmp", lbl_bit);
+    emit_label(lbl_next);
+    emit("add rax, ");
+    buf_write_int(out_buf, &out_cursor, scan_w);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("jmp", lbl_blk);
+    emit_label(lbl_tail);
+    emitln("cmp rax, r8");
+    emit_jmp("jae", lbl_none);
+    emitln("mov rsi, rax");
+    emitln("movzx ebx, byte [rdi+rax]");
+    emitln("cmp bl, [rdx]");
+    emit_jmp("jne", lbl_tnext);
+    emit_jmp("call", lbl_eq);
+    emit_jmp("je", lbl_found);
+    emit_label(lbl_tnext);
+    emitln("inc rax");
+    emit_jmp("jmp", lbl_tail);
+
+    // needle bytes 1 .. len-1 against hay + rsi — ZF set when they all match
+    emit_label(lbl_eq);
+    emitln("mov r9d, 1");
+    emit_label(lbl_eql);
+    emitln("cmp r9, rcx");
+    emit_jmp("jae", lbl_eqok);
+    emitln("lea rbx, [rsi+r9]");
+    emitln("movzx ebx, byte [rdi+rbx]");
+    emitln("cmp bl, [rdx+r9]");
+    emit_jmp("jne", lbl_eqret);
+    emitln("inc r9");
+    emit_jmp("jmp", lbl_eql);
+    emit_label(lbl_eqok);
+    emitln("cmp r9, r9");
+    emit_label(lbl_eqret);
+    emitln("ret");
+
+    emit_label(lbl_none);
+    emitln("mov rsi, -1");
+    emit_label(lbl_found);
+    emitln("mov rax, rsi");
+    emitln("pop rbx");
+    if (scan_avx2()) emitln("vzeroupper");
+    emit_label(lbl_ret);
+    emitln("ret");
+}
+
+static void emit_scan_helpers(void) {
+    if (scan_used & 1 << (TOK_FIND        - TOK_FIND)) emit_find();
+    if (scan_used & 1 << (TOK_FIND_BYTE   - TOK_FIND)) emit_find_byte();
+    if (scan_used & 1 << (TOK_COUNT_BYTE  - TOK_FIND)) emit_count_byte();
+    if (scan_used & 1 << (TOK_SPLIT_LINES - TOK_FIND)) emit_split_lines();
+}
+
+// s → rdi, rsi, then the other arguments as the helper expects them
+static void gen_scan(Node *n) {
+    static const char *helpers[] = {"k_find", "k_find_byte", "k_count_byte", "k_split_lines"};
+    gen_str(n->children[0]);
+    emitln("push rax");
+    emitln("push rdx");
+    if (n->ival == TOK_FIND) {
+        gen_str(n->children[1]);        // needle
+        emitln("mov rcx, rdx");
+        emitln("mov rdx, rax");
+    } else if (n->ival == TOK_SPLIT_LINES) {
+        gen_expr(n->children[1]);       // ends
+        emitln("push rax");
+        gen_expr(n->children[2]);       // max
+        emitln("mov rcx, rax");
+        emitln("pop rdx");
+    } else {
+        gen_expr(n->children[1]);       // byte
+        emitln("mov rdx, rax");
+    }
+    emitln("pop rsi");
+    emitln("pop rdi");
+    emit("call ");
+    buf_write_str(out_buf, &out_cursor, helpers[n->ival - TOK_FIND]);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    cse_clear();
+    scan_used |= 1 << (n->ival - TOK_FIND);
+}
+
+// ─────────────────────────────────────────
+// Memory builtins
+// copy(dst, src, n) / fill(dst, b, n) / compare(a, b, n) work on n bytes.
+// a constant n of at most 64 is open-coded as 16-byte SSE moves plus an
+// 8/4/2/1 tail. anything else calls a k_* helper: from 512 bytes on, copy
+// and fill use rep movsb / rep stosb, which move whole cache lines at a time
+// on current cores; below that they run the vector loop of the scan helpers
+// and finish with one block that overlaps the end instead of a byte tail.
+// copy's buffers must not overlap — it is memcpy, not memmove
+// ─────────────────────────────────────────
+#define MEMOP_INLINE_MAX 64
+#define MEMOP_REP_MIN    512
+
+static int mem_used = 0;                // 1 << (TOK_ - TOK_COPY) per helper called
+
+// 1 if n is open-coded — no call, only rax, rcx, rdi, rsi and xmm0 touched
+static int memop_inline(Node *n) {
+    Node *size = n->children[2];
+    return n->ival != TOK_COMPARE && size->type == NODE_NUMBER &&
+           size->ival >= 0 && size->ival <= MEMOP_INLINE_MAX;
+}
+
+// vector v ← bytes at [mem]
+static void emit_vload(int v, const char *mem) {
+    emit(scan_avx2() ? "vmovdqu " : "movdqu ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, ", [");
+    buf_write_str(out_buf, &out_cursor, mem);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+}
+
+// bytes at [mem] ← vector v
+static void emit_vstore(const char *mem, int v) {
+    emit(scan_avx2() ? "vmovdqu [" : "movdqu [");
+    buf_write_str(out_buf, &out_cursor, mem);
+    buf_write_str(out_buf, &out_cursor, "], ");
+    write_vreg(v);
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// cmp rdx, bytes — then jcc to lbl
+static void emit_size_jmp(int bytes, const char *jcc, int lbl) {
+    emit("cmp rdx, ");
+    buf_write_int(out_buf, &out_cursor, bytes);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp(jcc, lbl);
+}
+
+// rcx = rdx - vector bytes, the offset of the last (overlapping) block
+static void emit_last_block(void) {
+    emit("lea rcx, [rdx-");
+    buf_write_int(out_buf, &out_cursor, scan_w);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+}
+
+// add rax, vector bytes; loop to lbl while rax < rcx
+static void emit_block_next(int lbl) {
+    emit("add rax, ");
+    buf_write_int(out_buf, &out_cursor, scan_w);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("cmp rax, rcx");
+    emit_jmp("jb", lbl);
+}
+
+// k_copy(dst, src, n)
+static void emit_copy(void) {
+    int lbl_rep  = new_label();
+    int lbl_blk  = new_label();
+    int lbl_sm   = new_label();
+    int lbl_q    = new_label();
+    int lbl_d    = new_label();
+    int lbl_b    = new_label();
+    int lbl_done = new_label();
+
+    emit_str("\nalign 16\nk_copy:\n");
+    emit_size_jmp(MEMOP_REP_MIN, "jae", lbl_rep);
+    emit_size_jmp(scan_w, "jb", lbl_sm);
+    emit_last_block();
+    emitln("xor eax, eax");
+    emit_label(lbl_blk);
+    emit_vload(0, "rsi+rax");
+    emit_vstore("rdi+rax", 0);
+    emit_block_next(lbl_blk);
+    emit_vload(0, "rsi+rcx");
+    emit_vstore("rdi+rcx", 0);
+    emit_vret();
+
+    // under one vector — two moves that overlap in the middle
+    emit_label(lbl_sm);
+    if (scan_avx2()) {
+        emit_size_jmp(16, "jb", lbl_q);
+        emitln("vmovdqu xmm0, [rsi]");
+        emitln("vmovdqu xmm1, [rsi+rdx-16]");
+        emitln("vmovdqu [rdi], xmm0");
+        emitln("vmovdqu [rdi+rdx-16], xmm1");
+        emitln("ret");
+    }
+    emit_label(lbl_q);
+    emit_size_jmp(8, "jb", lbl_d);
+    emitln("mov rax, [rsi]");
+    emitln("mov rcx, [rsi+rdx-8]");
+    emitln("mov [rdi], rax");
+    emitln("mov [rdi+rdx-8], rcx");
+    emitln("ret");
+    emit_label(lbl_d);
+    emit_size_jmp(4, "jb", lbl_b);
+    emitln("mov eax, [rsi]");
+    emitln("mov ecx, [rsi+rdx-4]");
+    emitln("mov [rdi], eax");
+    emitln("mov [rdi+rdx-4], ecx");
+    emitln("ret");
+    emit_label(lbl_b);
+    emitln("test rdx, rdx");
+    emit_jmp("jz", lbl_done);
+    emitln("dec rdx");
+    emitln("mov al, [rsi+rdx]");
+    emitln("mov [rdi+rdx], al");
+    emit_jmp("jmp", lbl_b);
+    emit_label(lbl_rep);
+    emitln("mov rcx, rdx");
+    emitln("rep movsb");
+    emit_label(lbl_done);
+    emitln("ret");
+}
+
+// k_fill(dst, byte, n)
+static void emit_fill(void) {
+    int lbl_rep  = new_label();
+    int lbl_blk  = new_label();
+    int lbl_sm   = new_label();
+    int lbl_q    = new_label();
+    int lbl_d    = new_label();
+    int lbl_b    = new_label();
+    int lbl_done = new_label();
+
+    emit_str("\nalign 16\nk_fill:\n");
+    emit_size_jmp(MEMOP_REP_MIN, "jae", lbl_rep);
+    emitln("movzx eax, sil");
+    emitln("mov rcx, 0x0101010101010101");
+    emitln("imul rax, rcx");            // byte in all 8 lanes
+    emit_size_jmp(scan_w, "jb", lbl_sm);
+    emit_vbcast(0, "esi");
+    emit_last_block();
+    emitln("xor eax, eax");
+    emit_label(lbl_blk);
+    emit_vstore("rdi+rax", 0);
+    emit_block_next(lbl_blk);
+    emit_vstore("rdi+rcx", 0);
+    emit_vret();
+
+    emit_label(lbl_sm);
+    if (scan_avx2()) {
+        emit_size_jmp(16, "jb", lbl_q);
+        emitln("vmovq xmm0, rax");
+        emitln("vpunpcklqdq xmm0, xmm0, xmm0");
+        emitln("vmovdqu [rdi], xmm0");
+        emitln("vmovdqu [rdi+rdx-16], xmm0");
+        emitln("ret");
+    }
+    emit_label(lbl_q);
+    emit_size_jmp(8, "jb", lbl_d);
+    emitln("mov [rdi], rax");
+    emitln("mov [rdi+rdx-8], rax");
+    emitln("ret");
+    emit_label(lbl_d);
+    emit_size_jmp(4, "jb", lbl_b);
+    emitln("mov [rdi], eax");
+    emitln("mov [rdi+rdx-4], eax");
+    emitln("ret");
+    emit_label(lbl_b);
+    emitln("test rdx, rdx");
+    emit_jmp("jz", lbl_done);
+    emitln("dec rdx");
+    emitln("mov [rdi+rdx], al");
+    emit_jmp("jmp", lbl_b);
+    emit_label(lbl_rep);
+    emitln("mov eax, esi");
+    emitln("mov rcx, rdx");
+    emitln("rep stosb");
+    emit_label(lbl_done);
+    emitln("ret");
+}
+
+// k_compare(a, b, n) → 0 if equal, else a[i] - b[i] at the first byte that differs
+static void emit_compare(void) {
+    int lbl_blk  = new_label();
+    int lbl_tail = new_label();
+    int lbl_diff = new_label();
+    int lbl_ne   = new_label();
+    int lbl_eq   = new_label();
+
+    emit_str("\nalign 16\nk_compare:\n");
+    emitln("xor eax, eax");
+    emit_label(lbl_blk);
+    emit_vblock_check("rcx", "rax", "rdx", lbl_tail);
+    emit_vload(0, "rdi+rax");
+    emit_vcmpeq(1, "rsi+rax", 0);
+    emit_vmask("r8d", 1);
+    emitln(scan_avx2() ? "not r8d" : "xor r8d, 0xffff");   // set bits = differing bytes
+    emitln("test r8d, r8d");
+    emit_jmp("jnz", lbl_diff);
+    emitln("mov rax, rcx");
+    emit_jmp("jmp", lbl_blk);
+    emit_label(lbl_tail);
+    emitln("cmp rax, rdx");
+    emit_jmp("jae", lbl_eq);
+    emitln("movzx ecx, byte [rdi+rax]");
+    emitln("cmp cl, [rsi+rax]");
+    emit_jmp("jne", lbl_ne);
+    emitln("inc rax");
+    emit_jmp("jmp", lbl_tail);
+    emit_label(lbl_eq);
+    emitln("xor eax, eax");
+    emit_vret();
+    emit_label(lbl_diff);
+    emitln("bsf r8d, r8d");
+    emitln("add rax, r8");
+    emit_label(lbl_ne);
+    emitln("movzx ecx, byte [rdi+rax]");
+    emitln("movzx r8d, byte [rsi+rax]");
+    emitln("sub ecx, r8d");
+    emitln("movsxd rax, ecx");
+    emit_vret();
+}
+
+static void emit_mem_helpers(void) {
+    scan_avx2();                        // settles scan_w before any block size is written
+    if (mem_used & 1 << (TOK_COPY    - TOK_COPY)) emit_copy();
+    if (mem_used & 1 << (TOK_FILL    - TOK_COPY)) emit_fill();
+    if (mem_used & 1 << (TOK_COMPARE - TOK_COPY)) emit_compare();
+}
+
+// mov [rdi+off] ← reg / reg ← [rsi+off]
+static void emit_at(const char *op, const char *reg, const char *base, int off, int load) {
+    emit(op);
+    if (load) {
+        buf_write_str(out_buf, &out_cursor, reg);
+        buf_write_str(out_buf, &out_cursor, ", ");
+    }
+    buf_write_str(out_buf, &out_cursor, "[");
+    buf_write_str(out_buf, &out_cursor, base);
+    buf_write_str(out_buf, &out_cursor, "+");
+    buf_write_int(out_buf, &out_cursor, off);
+    buf_write_str(out_buf, &out_cursor, "]");
+    if (!load) {
+        buf_write_str(out_buf, &out_cursor, ", ");
+        buf_write_str(out_buf, &out_cursor, reg);
+    }
+    buf_write_str(out_buf, &out_cursor, "\n");
+}
+
+// constant-size copy / fill — rdi = dst, rsi = src or the fill byte
+static void gen_memop_inline(Node *n, int size) {
+    static const int   widths[] = {8, 4, 2, 1};
+    static const char *regs[]   = {"rax", "eax", "ax", "al"};
+    int off = 0;
+    if (n->ival == TOK_FILL) {
+        emitln("movzx eax, sil");
+        emitln("mov rcx, 0x0101010101010101");
+        emitln("imul rax, rcx");
+        if (size >= 16) {
+            emitln("movq xmm0, rax");
+            emitln("punpcklqdq xmm0, xmm0");
+        }
+    }
+    for (; off + 16 <= size; off += 16) {
+        if (n->ival == TOK_COPY) emit_at("movdqu ", "xmm0", "rsi", off, 1);
+        emit_at("movdqu ", "xmm0", "rdi", off, 0);
+    }
+    for (int i = 0; i < 4; i++)
+        for (; off + widths[i] <= size; off += widths[i]) {
+            if (n->ival == TOK_COPY) emit_at("mov ", regs[i], "rsi", off, 1);
+            emit_at("mov ", regs[i], "rdi", off, 0);
+        }
+}
+
+// copy / fill / compare — dst or a → rdi, src, byte or b → rsi, n → rdx
+static void gen_memop(Node *n) {
+    static const char *helpers[] = {"k_copy", "k_fill", "k_compare"};
+    gen_expr(n->children[0]);
+    emitln("push rax");
+    if (memop_inline(n)) {
+        gen_expr(n->children[1]);
+        emitln("mov rsi, rax");
+        emitln("pop rdi");
+        gen_memop_inline(n, n->children[2]->ival);
+        cse_clear();
+        return;
+    }
+    gen_expr(n->children[1]);
+    emitln("push rax");
+    gen_expr(n->children[2]);
+    emitln("mov rdx, rax");
+    emitln("pop rsi");
+    emitln("pop rdi");
+    emit("call ");
+    buf_write_str(out_buf, &out_cursor, helpers[n->ival - TOK_COPY]);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    cse_clear();
+    mem_used |= 1 << (n->ival - TOK_COPY);
+}
+
+// ─────────────────────────────────────────
+// Mapped files
+// map_file(path [, advice]) maps the whole file read-only and returns it as
+// a str, so a program scans its input in place instead of read()ing it into
+// an alloc'd buffer. advice goes to madvise — 2 = sequential (the default),
+// 3 = willneed, 0 = leave the kernel's readahead alone. an unreadable or
+// empty file maps to the empty str. unmap(s) releases the mapping
+// ─────────────────────────────────────────
+#define MADV_SEQUENTIAL 2
+
+static int map_used = 0;
+
+// k_map_file(path, advice) → rax = pointer, rdx = length (0, 0 on failure)
+static void emit_map_file(void) {
+    int lbl_close = new_label();
+    int lbl_fail  = new_label();
+    int lbl_ret   = new_label();
+    int lbl_done  = new_label();
+
+    emit_str("\nalign 16\nk_map_file:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("sub rsp, 152");             // struct stat
+    emitln("mov r12, rsi");             // advice
+    emitln("xor esi, esi");             // O_RDONLY
+    emitln("mov eax, 2");               // syscall 2 = open
+    emitln("syscall");
+    emitln("test rax, rax");
+    emit_jmp("js", lbl_fail);
+    emitln("mov rbx, rax");             // fd
+    emitln("mov rdi, rax");
+    emitln("mov rsi, rsp");
+    emitln("mov eax, 5");               // syscall 5 = fstat
+    emitln("syscall");
+    emitln("test rax, rax");
+    emit_jmp("js", lbl_close);
+    emitln("mov rsi, [rsp+48]");        // st_size
+    emitln("test rsi, rsi");
+    emit_jmp("jz", lbl_close);          // mmap refuses a zero length
+    emitln("mov [rsp], rsi");
+    emitln("xor edi, edi");
+    emitln("mov edx, 1");               // PROT_READ
+    emitln("mov r10d, 2");              // MAP_PRIVATE
+    emitln("mov r8, rbx");
+    emitln("xor r9d, r9d");
+    emitln("mov eax, 9");               // syscall 9 = mmap
+    emitln("syscall");
+    emitln("cmp rax, -4095");           // -errno
+    emit_jmp("jae", lbl_close);
+    emitln("mov [rsp+8], rax");
+    emitln("mov rdi, rbx");
+    emitln("mov eax, 3");               // syscall 3 = close — the mapping stays
+    emitln("syscall");
+    emitln("test r12, r12");
+    emit_jmp("jz", lbl_done);
+    emitln("mov rdi, [rsp+8]");
+    emitln("mov rsi, [rsp]");
+    emitln("mov rdx, r12");
+    emitln("mov eax, 28");              // syscall 28 = madvise — only a hint
+    emitln("syscall");
+    emit_label(lbl_done);
+    emitln("mov rax, [rsp+8]");
+    emitln("mov rdx, [rsp]");
+    emit_jmp("jmp", lbl_ret);
+    emit_label(lbl_close);
+    emitln("mov rdi, rbx");
+    emitln("mov eax, 3");
+    emitln("syscall");
+    emit_label(lbl_fail);
+    emitln("xor eax, eax");
+    emitln("xor edx, edx");
+    emit_label(lbl_ret);
+    emitln("add rsp, 152");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+}
+
+// path → rdi, advice → rsi
+static void gen_map_file(Node *n) {
+    if (n->right) {
+        gen_expr(n->right);
+        emitln("push rax");
+    }
+    gen_expr(n->left);
+    emitln("mov rdi, rax");
+    if (n->right) {
+        emitln("pop rsi");
+    } else {
+        emit("mov esi, ");
+        buf_write_int(out_buf, &out_cursor, MADV_SEQUENTIAL);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+    emitln("call k_map_file");
+    cse_clear();
+    map_used = 1;
+    n->dtype = DTYPE_STR;
+}
+
+// ─────────────────────────────────────────
+// Asynchronous I/O
+// submit_read / submit_write queue an operation and return its ticket;
+// wait_completions(results) submits everything queued with one
+// io_uring_enter, waits for all of it, and stores each ticket's result
+// (bytes moved or -errno) in results[ticket]. the ring is set up with raw
+// io_uring_setup / mmap on the first submit. where the kernel refuses
+// io_uring, each submit does the pread / pwrite on the spot instead, so
+// programs behave the same — they only lose the overlap
+// ─────────────────────────────────────────
+#define IO_ENTRIES    256               // tickets between two waits
+#define IORING_OP_READ  22
+#define IORING_OP_WRITE 23
+
+static int io_used = 0;
+
+// k_io_setup — io_ring = the ring's fd, or -1 to fall back to plain syscalls
+static void emit_io_setup(void) {
+    int lbl_map   = new_label();
+    int lbl_close = new_label();
+    int lbl_off   = new_label();
+    int lbl_ret   = new_label();
+
+    emit_str("\nalign 16\nk_io_setup:\n");
+    emitln("push rbx");
+    emitln("sub rsp, 128");             // struct io_uring_params
+    emitln("xor eax, eax");
+    emitln("mov rdi, rsp");
+    emitln("mov ecx, 15");
+    emitln("rep stosq");
+    emit("mov edi, ");
+    buf_write_int(out_buf, &out_cursor, IO_ENTRIES);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("mov rsi, rsp");
+    emitln("mov eax, 425");             // syscall 425 = io_uring_setup
+    emitln("syscall");
+    emitln("test rax, rax");
+    emit_jmp("js", lbl_off);
+    emitln("mov rbx, rax");             // ring fd
+
+    // submission ring — head/tail/mask/array live at the offsets in sq_off
+    emitln("mov esi, [rsp]");           // sq_entries
+    emitln("shl esi, 2");
+    emitln("mov eax, [rsp+64]");        // sq_off.array
+    emitln("add rsi, rax");
+    emitln("xor r9d, r9d");             // IORING_OFF_SQ_RING
+    emit_jmp("call", lbl_map);
+    emitln("cmp rax, -4095");
+    emit_jmp("jae", lbl_close);
+    emitln("mov ecx, [rsp+44]");        // sq_off.tail
+    emitln("add rcx, rax");
+    emitln("mov [rel io_sq_tail], rcx");
+    emitln("mov ecx, [rsp+48]");        // sq_off.ring_mask
+    emitln("mov ecx, [rax+rcx]");
+    emitln("mov [rel io_sq_mask], rcx");
+    emitln("mov ecx, [rsp+64]");
+    emitln("add rcx, rax");
+    emitln("mov [rel io_sq_array], rcx");
+
+    // completion ring
+    emitln("mov esi, [rsp+4]");         // cq_entries
+    emitln("shl esi, 4");
+    emitln("mov eax, [rsp+100]");       // cq_off.cqes
+    emitln("add rsi, rax");
+    emitln("mov r9d, 0x8000000");       // IORING_OFF_CQ_RING
+    emit_jmp("call", lbl_map);
+    emitln("cmp rax, -4095");
+    emit_jmp("jae", lbl_close);
+    emitln("mov ecx, [rsp+80]");        // cq_off.head
+    emitln("add rcx, rax");
+    emitln("mov [rel io_cq_head], rcx");
+    emitln("mov ecx, [rsp+84]");        // cq_off.tail
+    emitln("add rcx, rax");
+    emitln("mov [rel io_cq_tail], rcx");
+    emitln("mov ecx, [rsp+88]");        // cq_off.ring_mask
+    emitln("mov ecx, [rax+rcx]");
+    emitln("mov [rel io_cq_mask], rcx");
+    emitln("mov ecx, [rsp+100]");
+    emitln("add rcx, rax");
+    emitln("mov [rel io_cqes], rcx");
+
+    // the submission queue entries themselves, 64 bytes each
+    emitln("mov esi, [rsp]");
+    emitln("shl esi, 6");
+    emitln("mov r9d, 0x10000000");      // IORING_OFF_SQES
+    emit_jmp("call", lbl_map);
+    emitln("cmp rax, -4095");
+    emit_jmp("jae", lbl_close);
+    emitln("mov [rel io_sqes], rax");
+    emitln("mov [rel io_ring], rbx");
+    emit_jmp("jmp", lbl_ret);
+
+    // mmap(0, rsi, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, r9)
+    emit_label(lbl_map);
+    emitln("xor edi, edi");
+    emitln("mov edx, 3");
+    emitln("mov r10d, 0x8001");
+    emitln("mov r8, rbx");
+    emitln("mov eax, 9");               // syscall 9 = mmap
+    emitln("syscall");
+    emitln("ret");
+
+    emit_label(lbl_close);
+    emitln("mov rdi, rbx");
+    emitln("mov eax, 3");               // syscall 3 = close
+    emitln("syscall");
+    emit_label(lbl_off);
+    emitln("mov qword [rel io_ring], -1");
+    emit_label(lbl_ret);
+    emitln("add rsp, 128");
+    emitln("pop rbx");
+    emitln("ret");
+}
+
+// k_io_submit(op, fd, buf, n, offset) → ticket, or -1 with IO_ENTRIES outstanding.
+// offset -1 means the file position, as for read / write
+static void emit_io_submit(void) {
+    int lbl_ready  = new_label();
+    int lbl_sync   = new_label();
+    int lbl_plain  = new_label();
+    int lbl_ticket = new_label();
+    int lbl_full   = new_label();
+
+    emit_str("\nalign 16\nk_io_submit:\n");
+    emitln("mov rax, [rel io_count]");
+    emit("cmp rax, ");
+    buf_write_int(out_buf, &out_cursor, IO_ENTRIES);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("jae", lbl_full);
+    emitln("cmp qword [rel io_ring], 0");
+    emit_jmp("jne", lbl_ready);
+    emitln("push rdi");
+    emitln("push rsi");
+    emitln("push rdx");
+    emitln("push rcx");
+    emitln("push r8");
+    emitln("call k_io_setup");
+    emitln("pop r8");
+    emitln("pop rcx");
+    emitln("pop rdx");
+    emitln("pop rsi");
+    emitln("pop rdi");
+    emit_label(lbl_ready);
+    emitln("cmp qword [rel io_ring], 0");
+    emit_jmp("jl", lbl_sync);
+
+    // fill the entry at the tail, then publish it by bumping the tail —
+    // x86 keeps the stores in order, so the kernel never sees a half entry
+    emitln("mov r9, [rel io_sq_tail]");
+    emitln("mov r10d, [r9]");
+    emitln("mov r11, [rel io_sq_mask]");
+    emitln("and r11d, r10d");           // slot
+    emitln("mov rax, r11");
+    emitln("shl rax, 6");
+    emitln("add rax, [rel io_sqes]");
+    emitln("pxor xmm0, xmm0");
+    emitln("movdqu [rax], xmm0");
+    emitln("movdqu [rax+16], xmm0");
+    emitln("movdqu [rax+32], xmm0");
+    emitln("movdqu [rax+48], xmm0");
+    emitln("mov [rax], dil");           // opcode
+    emitln("mov [rax+4], esi");         // fd
+    emitln("mov [rax+8], r8");          // off
+    emitln("mov [rax+16], rdx");        // addr
+    emitln("mov [rax+24], ecx");        // len
+    emitln("mov rcx, [rel io_count]");
+    emitln("mov [rax+32], rcx");        // user_data = ticket
+    emitln("mov rax, [rel io_sq_array]");
+    emitln("mov [rax+r11*4], r11d");
+    emitln("inc r10d");
+    emitln("mov [r9], r10d");
+    emitln("inc qword [rel io_pending]");
+    emitln("lea rax, [rel io_res]");
+    emitln("mov qword [rax+rcx*8], -125");  // -ECANCELED until it completes
+    emit_jmp("jmp", lbl_ticket);
+
+    // no ring — do it now: read / write, or pread64 / pwrite64 at an offset
+    emit_label(lbl_sync);
+    emitln("mov eax, edi");
+    emitln("mov rdi, rsi");
+    emitln("mov rsi, rdx");
+    emitln("mov rdx, rcx");
+    emitln("mov r10, r8");
+    emit("sub eax, ");
+    buf_write_int(out_buf, &out_cursor, IORING_OP_READ);
+    buf_write_str(out_buf, &out_cursor, "\n");              // syscall 0 = read, 1 = write
+    emitln("cmp r8, -1");
+    emit_jmp("je", lbl_plain);
+    emitln("add eax, 17");              // syscall 17 = pread64, 18 = pwrite64
+    emit_label(lbl_plain);
+    emitln("syscall");
+    emitln("mov rcx, [rel io_count]");
+    emitln("lea rdx, [rel io_res]");
+    emitln("mov [rdx+rcx*8], rax");
+    emit_label(lbl_ticket);
+    emitln("mov rax, [rel io_count]");
+    emitln("inc qword [rel io_count]");
+    emitln("ret");
+    emit_label(lbl_full);
+    emitln("mov rax, -1");
+    emitln("ret");
+}
+
+// k_io_wait(results) → tickets completed; results may be 0 to drop them
+static void emit_io_wait(void) {
+    int lbl_enter  = new_label();
+    int lbl_reap   = new_label();
+    int lbl_reaped = new_label();
+    int lbl_copy   = new_label();
+    int lbl_cp     = new_label();
+    int lbl_reset  = new_label();
+
+    emit_str("\nalign 16\nk_io_wait:\n");
+    emitln("push rbx");
+    emitln("mov rbx, rdi");
+    emitln("cmp qword [rel io_ring], 0");
+    emit_jmp("jle", lbl_copy);          // no ring — results are already in
+    emit_label(lbl_enter);
+    emitln("mov rdx, [rel io_count]");
+    emitln("sub rdx, [rel io_done]");   // completions still owed
+    emit_jmp("jz", lbl_copy);
+    emitln("mov rdi, [rel io_ring]");
+    emitln("mov rsi, [rel io_pending]");
+    emitln("mov r10d, 1");              // IORING_ENTER_GETEVENTS
+    emitln("xor r8d, r8d");
+    emitln("xor r9d, r9d");
+    emitln("mov eax, 426");             // syscall 426 = io_uring_enter
+    emitln("syscall");
+    emitln("cmp rax, -4");              // EINTR — go round again
+    emit_jmp("je", lbl_enter);
+    emitln("test rax, rax");
+    emit_jmp("js", lbl_copy);           // the rest stay -ECANCELED
+    emitln("sub [rel io_pending], rax");
+    emitln("mov rsi, [rel io_cq_head]");
+    emitln("mov ecx, [rsi]");
+    emitln("mov rdi, [rel io_cq_tail]");
+    emit_label(lbl_reap);
+    emitln("cmp ecx, [rdi]");
+    emit_jmp("je", lbl_reaped);
+    emitln("mov eax, ecx");
+    emitln("and rax, [rel io_cq_mask]");
+    emitln("shl eax, 4");
+    emitln("add rax, [rel io_cqes]");
+    emitln("mov rdx, [rax]");           // user_data = ticket
+    emitln("movsxd rax, dword [rax+8]");    // res
+    emitln("lea r8, [rel io_res]");
+    emitln("mov [r8+rdx*8], rax");
+    emitln("inc qword [rel io_done]");
+    emitln("inc ecx");
+    emit_jmp("jmp", lbl_reap);
+    emit_label(lbl_reaped);
+    emitln("mov [rsi], ecx");           // hand the entries back
+    emit_jmp("jmp", lbl_enter);
+
+    emit_label(lbl_copy);
+    emitln("xor ecx, ecx");
+    emitln("lea rsi, [rel io_res]");
+    emitln("test rbx, rbx");
+    emit_jmp("jz", lbl_reset);
+    emit_label(lbl_cp);
+    emitln("cmp rcx, [rel io_count]");
+    emit_jmp("jae", lbl_reset);
+    emitln("mov rax, [rsi+rcx*8]");
+    emitln("mov [rbx+rcx*8], rax");
+    emitln("inc rcx");
+    emit_jmp("jmp", lbl_cp);
+    emit_label(lbl_reset);
+    emitln("mov rax, [rel io_count]");
+    emitln("mov qword [rel io_count], 0");
+    emitln("mov qword [rel io_done], 0");
+    emitln("pop rbx");
+    emitln("ret");
+}
+
+static void emit_io_runtime(void) {
+    emit_io_setup();
+    emit_io_submit();
+    emit_io_wait();
+    buf_write_str(str_buf, &str_cursor,
+        "    io_ring     dq 0\n"
+        "    io_sq_tail  dq 0\n"
+        "    io_sq_mask  dq 0\n"
+        "    io_sq_array dq 0\n"
+        "    io_sqes     dq 0\n"
+        "    io_cq_head  dq 0\n"
+        "    io_cq_tail  dq 0\n"
+        "    io_cq_mask  dq 0\n"
+        "    io_cqes     dq 0\n"
+        "    io_count    dq 0\n"
+        "    io_pending  dq 0\n"
+        "    io_done     dq 0\n");
+}
+
+// submit: op → rdi, fd → rsi, buf → rdx, n → rcx, offset → r8. wait: results → rdi
+static void gen_io(Node *n) {
+    if (n->ival == TOK_WAIT_COMPLETIONS) {
+        gen_expr(n->children[0]);
+        emitln("mov rdi, rax");
+        emitln("call k_io_wait");
+    } else {
+        for (int i = 0; i < n->child_count; i++) {
+            gen_expr(n->children[i]);
+            emitln("push rax");
+        }
+        if (n->child_count == 4) emitln("pop r8");
+        else                     emitln("mov r8, -1");
+        emitln("pop rcx");
+        emitln("pop rdx");
+        emitln("pop rsi");
+        emit("mov edi, ");
+        buf_write_int(out_buf, &out_cursor,
+                      n->ival == TOK_SUBMIT_READ ? IORING_OP_READ : IORING_OP_WRITE);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emitln("call k_io_submit");
+    }
+    cse_clear();
+    io_used = 1;
+}
+
+// ─────────────────────────────────────────
+// Vectored and in-kernel transfers
+// readv / writev take an array of (pointer, length) word pairs — a ptr laid
+// out as struct iovec — and move all of them with one syscall. copy_file
+// moves n bytes from one fd to another without them passing through the
+// program: copy_file_range, and sendfile where the kernel refuses that
+// (pipes, sockets, file systems without support). each returns the bytes
+// moved, or -errno when nothing was
+// ─────────────────────────────────────────
+static int xfer_used = 0;
+
+// k_copy_file(in, out, n) → bytes copied
+static void emit_copy_file(void) {
+    int lbl_cfr  = new_label();
+    int lbl_cend = new_label();
+    int lbl_sf   = new_label();
+    int lbl_send = new_label();
+    int lbl_done = new_label();
+
+    emit_str("\nalign 16\nk_copy_file:\n");
+    emitln("push rbx");
+    emitln("push r12");
+    emitln("push r13");
+    emitln("push r14");
+    emitln("mov rbx, rdi");             // in
+    emitln("mov r12, rsi");             // out
+    emitln("mov r13, rdx");             // bytes left
+    emitln("xor r14d, r14d");           // bytes copied
+    emit_label(lbl_cfr);
+    emitln("test r13, r13");
+    emit_jmp("jle", lbl_done);
+    emitln("mov rdi, rbx");
+    emitln("xor esi, esi");             // NULL — use and advance the file positions
+    emitln("mov rdx, r12");
+    emitln("xor r10d, r10d");
+    emitln("mov r8, r13");
+    emitln("xor r9d, r9d");
+    emitln("mov eax, 326");             // syscall 326 = copy_file_range
+    emitln("syscall");
+    emitln("test rax, rax");
+    emit_jmp("jle", lbl_cend);
+    emitln("add r14, rax");
+    emitln("sub r13, rax");
+    emit_jmp("jmp", lbl_cfr);
+    emit_label(lbl_cend);
+    emit_jmp("jz", lbl_done);           // end of input
+
+    // refused — finish with sendfile, which takes out first
+    emit_label(lbl_sf);
+    emitln("test r13, r13");
+    emit_jmp("jle", lbl_done);
+    emitln("mov rdi, r12");
+    emitln("mov rsi, rbx");
+    emitln("xor edx, edx");
+    emitln("mov r10, r13");
+    emitln("mov eax, 40");              // syscall 40 = sendfile
+    emitln("syscall");
+    emitln("test rax, rax");
+    emit_jmp("jle", lbl_send);
+    emitln("add r14, rax");
+    emitln("sub r13, rax");
+    emit_jmp("jmp", lbl_sf);
+    emit_label(lbl_send);
+    emit_jmp("jz", lbl_done);
+    emitln("test r14, r14");
+    emit_jmp("jnz", lbl_done);          // report the error only if nothing moved
+    emitln("mov r14, rax");
+    emit_label(lbl_done);
+    emitln("mov rax, r14");
+    emitln("pop r14");
+    emitln("pop r13");
+    emitln("pop r12");
+    emitln("pop rbx");
+    emitln("ret");
+}
+
+// fd / in → rdi, iov / out → rsi, count / n → rdx
+static void gen_xfer(Node *n) {
+    gen_expr(n->children[0]);
+    emitln("push rax");
+    gen_expr(n->children[1]);
+    emitln("push rax");
+    gen_expr(n->children[2]);
+    emitln("mov rdx, rax");
+    emitln("pop rsi");
+    emitln("pop rdi");
+    if (n->ival == TOK_COPY_FILE) {
+        emitln("call k_copy_file");
+        xfer_used = 1;
+    } else if (n->ival == TOK_READV) {
+        emitln("mov eax, 19");          // syscall 19 = readv
+        emitln("syscall");
+    } else {
+        emitln("mov eax, 20");          // syscall 20 = writev
+        emitln("syscall");
+    }
+    cse_clear();
+}
+
+// ─────────────────────────────────────────
+// Software prefetch
+// --prefetch[=N]: for loops that index ptr arrays with the loop variable
+// touch each accessed element N iterations ahead of its use
+// ─────────────────────────────────────────
+#define MAX_PREFETCH 8
+static const char *prefetch_instr[4] = {"prefetcht0", "prefetcht1", "prefetcht2", "prefetchnta"};
+
+typedef struct {
+    char  name[64];     // ptr array
+    Node *index;        // index expression using the loop variable
+} PrefetchSite;
+
+// 1 if n is plain arithmetic on the counter and int variables the loop never
+// writes — no loads, calls or division, so computing it iterations ahead is
+// safe. each variable must already have a slot: an index that uses an inner
+// loop's counter or a let further down can't be computed at the top
+static int prefetch_index_ok(Node *n, const char *var, Node *body) {
+    switch (n->type) {
+    case NODE_NUMBER:
+        return 1;
+    case NODE_IDENT: {
+        int known = 0;
+        for (int i = 0; i < var_count && !known; i++)
+            known = strcmp(var_table[i].name, n->name) == 0;
+        for (int i = 0; i < param_count && !known; i++)
+            known = strcmp(param_table[i].name, n->name) == 0;
+        if (!known || var_dtype(n->name) != DTYPE_INT) return 0;
+        return strcmp(n->name, var) == 0 || !node_writes_var(body, n->name);
+    }
+    case NODE_NEG:
+        return prefetch_index_ok(n->right, var, body);
+    case NODE_BINOP:
+        if (!strchr("+-*&|^", n->op[0]) || n->op[1]) return 0;
+        return prefetch_index_ok(n->left, var, body) && prefetch_index_ok(n->right, var, body);
+    default:
+        return 0;
+    }
+}
+
+// collect distinct ptr[index] patterns whose index depends on var
+static int collect_prefetch(Node *n, const char *var, Node *body, PrefetchSite *sites, int count) {
+    if (!n) return count;
+    if ((n->type == NODE_ARRAY_ACCESS || n->type == NODE_ARRAY_ASSIGN) &&
+        var_dtype(n->name) == DTYPE_PTR &&
+        node_uses_var(n->left, var) && prefetch_index_ok(n->left, var, body)) {
+        int seen = 0;
+        for (int i = 0; i < count; i++)
+            if (strcmp(sites[i].name, n->name) == 0 && node_equal(sites[i].index, n->left))
+                seen = 1;
+        if (!seen && count < MAX_PREFETCH) {
+            strncpy(sites[count].name, n->name, 63);
+            sites[count].index = n->left;
+            count++;
+        }
+    }
+    count = collect_prefetch(n->left,  var, body, sites, count);
+    count = collect_prefetch(n->right, var, body, sites, count);
+    for (int i = 0; i < n->child_count; i++)
+        count = collect_prefetch(n->children[i], var, body, sites, count);
+    return count;
+}
+
+// prefetch every site with the loop variable read as var + delta
+static void emit_prefetches(PrefetchSite *sites, int count, const char *var, int delta) {
+    int saved_delta = iv_delta;
+    for (int i = 0; i < count; i++) {
+        strncpy(iv_name, var, 63);
+        iv_delta = delta;
+        gen_expr(sites[i].index);               // index ahead → rax
+        emit_mem("mov rbx, ", var_offset(sites[i].name), "");
+        emitln("prefetcht0 [rbx+rax*8]");
+    }
+    iv_delta = saved_delta;
+    cse_clear();                                // r11 may hold a value computed ahead
+}
+
+// prefetch sites for a for loop — 0 when the pass is off or nothing qualifies
+static int loop_prefetch_sites(Node *n, Node *filter, PrefetchSite *sites) {
+    if (options.prefetch <= 0) return 0;
+    Node *body = n->children[3];
+    if (!block_accesses_array(body, n->name)) return 0;
+    int count = collect_prefetch(filter, n->name, body, sites, 0);
+    count     = collect_prefetch(body, n->name, body, sites, count);
+    if (count)
+        remark(n, "prefetch", 1, "%d access%s prefetched %d iterations ahead",
+               count, count > 1 ? "es" : "", options.prefetch);
+    else
+        remark(n, "prefetch", 0, "no ptr array indexed by '%s'", n->name);
+    return count;
+}
+
+// ─────────────────────────────────────────
+// Loop unrolling
+// a counted loop runs `factor` body copies per trip while a whole group fits
+// below the limit, stepping the counter once per group. the regular loop
+// emitted after it runs the remaining < factor iterations
+// ─────────────────────────────────────────
+#define MAX_UNROLL 16
+
+// number of nodes in the tree — rough body size for the unroll heuristic
+static int node_size(Node *n) {
+    if (!n) return 0;
+    int size = 1 + node_size(n->left) + node_size(n->right);
+    for (int i = 0; i < n->child_count; i++)
+        size += node_size(n->children[i]);
+    return size;
+}
+
+// copies read the counter as base + k*step, so the body must not change it,
+// take its address or leave the loop early with break
+static int unroll_body_ok(Node *n, const char *var) {
+    if (!n) return 1;
+    if (n->type == NODE_BREAK) return 0;
+    if (n->type == NODE_FOR || n->type == NODE_FOR_IF ||
+        n->type == NODE_WHILE || n->type == NODE_DO_WHILE) return 0;
+    if ((n->type == NODE_ASSIGN || n->type == NODE_REASSIGN || n->type == NODE_ADDR) &&
+        strcmp(n->name, var) == 0) return 0;
+    if (n->type == NODE_ASSIGN_MULTI &&
+        (strcmp(n->name, var) == 0 || strcmp(n->sval, var) == 0)) return 0;
+    if (!unroll_body_ok(n->left, var) || !unroll_body_ok(n->right, var)) return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!unroll_body_ok(n->children[i], var)) return 0;
+    return 1;
+}
+
+static int unroll_missed(Node *n, const char *why) {
+    remark(n, "unroll", 0, "not unrolled: %s", why);
+    return 1;
+}
+
+// 'unroll N' wins, otherwise small bodies get 8 or 4 copies — 1 = don't unroll
+static int unroll_factor(Node *n, Node *filter) {
+    Node *body = n->children[3];
+    Node *step = n->children[2];
+    if (step->type != NODE_NUMBER || step->ival <= 0)
+        return unroll_missed(n, "step is not a positive constant");
+    if (!unroll_body_ok(body, n->name) || !unroll_body_ok(filter, n->name))
+        return unroll_missed(n, "body breaks, nests a loop or writes the counter");
+
+    int factor = n->unroll;
+    if (!factor) {
+        int size = node_size(body) + node_size(filter);
+        factor = size <= 12 ? 8 : size <= 40 ? 4 : 1;
+        if (factor == 1) return unroll_missed(n, "body too large");
+        // known trip count too short to fill two groups — not worth the code
+        int range = get_loop_range(n->children[1], n->children[0]);
+        if (range >= 0 && range / step->ival + 1 < 2 * factor)
+            return unroll_missed(n, "trip count too short");
+        // profiled: never-run loops aren't worth the code, short trips get
+        // the largest factor that still fills two groups on average
+        if (prof_data && n->prof_id) {
+            long entries = prof_count(n, 0);
+            if (!entries) return unroll_missed(n, "never entered in the profile");
+            while (factor > 1 && prof_count(n, 1) / entries < 2 * factor) factor /= 2;
+            if (factor == 1) return unroll_missed(n, "profiled trips too short");
+        }
+    }
+    if (factor > MAX_UNROLL) factor = MAX_UNROLL;
+    if (factor > 1) remark(n, "unroll", 1, "unrolled by %d", factor);
+    return factor;
+}
+
+// prefetches at the top of a regular (not unrolled) loop body
+static void emit_loop_prefetch(Node *n, Node *filter) {
+    PrefetchSite sites[MAX_PREFETCH];
+    int count = loop_prefetch_sites(n, filter, sites);
+    if (count && n->children[2]->type == NODE_NUMBER)
+        emit_prefetches(sites, count, n->name, options.prefetch * n->children[2]->ival);
+}
+
+// emit the unrolled group loop — filter is the for-where condition (or NULL)
+static void gen_unrolled(Node *n, Node *filter, int off, int loop_reg,
+                         int nested, int lim_off, int factor) {
+    Node *body = n->children[3];
+    int step   = n->children[2]->ival;
+    PrefetchSite sites[MAX_PREFETCH];
+    int prefetches = loop_prefetch_sites(n, filter, sites);
+    int lbl_group = new_label();
+    int lbl_check = new_label();
+    int saved_var_count = var_count;
+    int saved_stack_top = stack_top;
+
+    emit_jmp("jmp", lbl_check);
+    emit_label(lbl_group);
+    for (int k = 0; k < factor; k++) {
+        var_count = saved_var_count;            // copies share the body's slots
+        stack_top = saved_stack_top;
+        int lbl_next = new_label();
+        loop_push(loop_break(), lbl_next);      // continue → next copy
+        // one prefetch per 64-byte line of elements
+        if (prefetches && (k * step) % 8 == 0)
+            emit_prefetches(sites, prefetches, n->name, (k + options.prefetch) * step);
+        strncpy(iv_name, n->name, 63);
+        iv_delta = k * step;
+        cse_clear();
+        if (filter) {
+            gen_expr(filter);
+            emitln("test rax, rax");
+            emit_jmp("jz", lbl_next);
+        }
+        emit_prof_inc(n, 1);
+        gen_stmt(body);
+        iv_delta = 0;
+        emit_label(lbl_next);
+        loop_pop();
+    }
+    var_count = saved_var_count;                // remainder loop reuses them too
+    stack_top = saved_stack_top;
+
+    // step once per group
+    iv_advance(n->name, factor);
+    if (loop_reg >= 0) {
+        emit("add ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+        buf_write_str(out_buf, &out_cursor, ", ");
+        buf_write_int(out_buf, &out_cursor, factor * step);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit("mov [rbp-");
+        buf_write_int(out_buf, &out_cursor, off);
+        buf_write_str(out_buf, &out_cursor, "], ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    } else {
+        emit_mem("mov rax, ", off, "");
+        emit("add rax, ");
+        buf_write_int(out_buf, &out_cursor, factor * step);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit_mem("mov ", off, ", rax");
+    }
+
+    // another whole group fits while counter + (factor-1)*step <= limit
+    emit_label(lbl_check);
+    if (loop_reg >= 0) {
+        emit("lea rax, [");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+        buf_write_str(out_buf, &out_cursor, "+");
+        buf_write_int(out_buf, &out_cursor, (factor - 1) * step);
+        buf_write_str(out_buf, &out_cursor, "]\n");
+    } else {
+        emit_mem("mov rax, ", off, "");
+        emit("add rax, ");
+        buf_write_int(out_buf, &out_cursor, (factor - 1) * step);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+    if (nested) emit_mem("cmp rax, ", lim_off, "");
+    else        emitln("cmp rax, r14");
+    emit_jmp("jle", lbl_group);
+}
+
+// ─────────────────────────────────────────
+// Loop tiling
+// a perfect nest over arrays is split into tile loops and point loops
+// so each tile's working set stays in cache:
+//   for ii = si to li step Ti
+//     for jj = sj to lj step Tj
+//       for i = ii to min(ii + Ti - 1, li)
+//         for j = jj to min(jj + Tj - 1, lj)
+//           body
+// the innermost two tile edges are sized for L1, outer ones for L2
+// ─────────────────────────────────────────
+#define MAX_NEST 4
+
+// first line of a sysfs file, 0 if missing
+static int read_line(const char *path, char *buf, int size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+// data/unified cache size at `level` from sysfs, 0 if unknown
+static long sysfs_cache_size(int level) {
+    char path[128], buf[64];
+    for (int idx = 0; idx < 8; idx++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        if (!read_line(path, buf, sizeof(buf))) break;
+        if (atoi(buf) != level) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+        if (!read_line(path, buf, sizeof(buf)) || strncmp(buf, "Instruction", 11) == 0) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        if (!read_line(path, buf, sizeof(buf))) continue;
+        char *end;
+        long size = strtol(buf, &end, 10);
+        if (*end == 'K') size *= 1024;
+        if (*end == 'M') size *= 1024 * 1024;
+        return size;
+    }
+    return 0;
+}
+
+// same from cpuid leaf 4 (deterministic cache parameters), 0 if unknown
+static long cpuid_cache_size(int level) {
+    unsigned a, b, c, d;
+    for (unsigned idx = 0; idx < 8; idx++) {
+        if (!__get_cpuid_count(4, idx, &a, &b, &c, &d)) return 0;
+        unsigned type = a & 0x1f;               // 0 = no more caches, 2 = instruction
+        if (type == 0) break;
+        if (type == 2 || (int)((a >> 5) & 7) != level) continue;
+        long ways  = ((b >> 22) & 0x3ff) + 1;
+        long parts = ((b >> 12) & 0x3ff) + 1;
+        long line  = (b & 0xfff) + 1;
+        return ways * parts * line * ((long)c + 1);
+    }
+    return 0;
+}
+
+// cache sizes of the compiling machine — flags win, then sysfs, then cpuid
+static void cache_sizes(long *l1, long *l2) {
+    static long det_l1 = -1, det_l2 = -1;
+    if (det_l1 < 0) {
+        det_l1 = sysfs_cache_size(1);
+        if (det_l1 <= 0) det_l1 = cpuid_cache_size(1);
+        if (det_l1 <= 0) det_l1 = 32 * 1024;
+        det_l2 = sysfs_cache_size(2);
+        if (det_l2 <= 0) det_l2 = cpuid_cache_size(2);
+        if (det_l2 <= 0) det_l2 = 256 * 1024;
+    }
+    *l1 = options.l1_cache > 0 ? options.l1_cache : det_l1;
+    *l2 = options.l2_cache > 0 ? options.l2_cache : det_l2;
+}
+
+// tile edge (in elements) for each nest level, `arrays` arrays of 8-byte
+// elements touched per iteration: T1*T1 per array fits L1, T2*T1 fits L2
+static void tile_sizes(int depth, int arrays, int *tiles) {
+    long l1, l2;
+    cache_sizes(&l1, &l2);
+    long t1 = 1;
+    while ((t1 + 1) * (t1 + 1) * 8 * arrays <= l1) t1++;
+    t1 = t1 < 8 ? 8 : t1 & ~7L;
+    long t2 = l2 / (8 * arrays * t1);
+    t2 = t2 < t1 ? t1 : t2 > 4096 ? 4096 : t2 & ~7L;
+    for (int k = 0; k < depth; k++) {
+        tiles[k] = k >= depth - 2 ? (int)t1 : (int)t2;
+        if (options.tile_size > 0) tiles[k] = options.tile_size;
+    }
+}
+
+// body may only compute and store — no calls, I/O, control transfer or
+// address-taking, so iterations can run in any tile order
+static int tile_body_ok(Node *n) {
+    if (!n) return 1;
+    switch (n->type) {
+    case NODE_BLOCK: case NODE_IF: case NODE_ELIF: case NODE_ELSE:
+    case NODE_REASSIGN: case NODE_ARRAY_ASSIGN:
+    case NODE_NUMBER: case NODE_BOOL: case NODE_IDENT: case NODE_BINOP:
+    case NODE_NEG: case NODE_ARRAY_ACCESS: case NODE_FIELD_ACCESS:
+    case NODE_AND: case NODE_OR: case NODE_BITNOT: case NODE_INTRINSIC:
+    case NODE_SELECT:
+        break;
+    case NODE_ASSIGN:
+        if (n->right->type == NODE_STRUCT_INIT) return 0;
+        break;
+    default:
+        return 0;
+    }
+    if (!tile_body_ok(n->left) || !tile_body_ok(n->right)) return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!tile_body_ok(n->children[i])) return 0;
+    return 1;
+}
+
+// returns 1 if the tree reads array `name`
+static int node_reads_array(Node *n, const char *name) {
+    if (!n) return 0;
+    if (n->type == NODE_ARRAY_ACCESS && strcmp(n->name, name) == 0) return 1;
+    if (node_reads_array(n->left, name) || node_reads_array(n->right, name)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_reads_array(n->children[i], name)) return 1;
+    return 0;
+}
+
+// target + e, e + target or target - e, with e not reading target
+static int is_reduction(Node *target, Node *rhs) {
+    if (rhs->type != NODE_BINOP) return 0;
+    int plus = strcmp(rhs->op, "+") == 0;
+    if (!plus && strcmp(rhs->op, "-") != 0) return 0;
+    Node *other = NULL;
+    if (node_equal(rhs->left, target))               other = rhs->right;
+    else if (plus && node_equal(rhs->right, target)) other = rhs->left;
+    if (!other) return 0;
+    if (target->type == NODE_IDENT) return node_count_uses(other, target->name) == 0;
+    return !node_reads_array(other, target->name);
+}
+
+// does any array access in n name `array` at an index other than `index`?
+static int other_index(Node *n, const char *array, Node *index) {
+    if (!n) return 0;
+    if ((n->type == NODE_ARRAY_ACCESS || n->type == NODE_ARRAY_ASSIGN) &&
+        strcmp(n->name, array) == 0 && !node_equal(n->left, index)) return 1;
+    if (other_index(n->left, array, index) || other_index(n->right, array, index)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (other_index(n->children[i], array, index)) return 1;
+    return 0;
+}
+
+// add the nest-counter strides of e (times scale) to stride[] — 0 unless e
+// is a sum of constant multiples of counters and terms the body never writes
+static int tile_affine(Node *e, Node **loops, int depth, Node *body, long scale, long *stride) {
+    switch (e->type) {
+    case NODE_NUMBER:
+        return 1;
+    case NODE_IDENT:
+        for (int k = 0; k < depth; k++)
+            if (strcmp(e->name, loops[k]->name) == 0) { stride[k] += scale; return 1; }
+        return !node_writes_var(body, e->name);
+    case NODE_NEG:
+        return tile_affine(e->right, loops, depth, body, -scale, stride);
+    case NODE_BINOP:
+        if (strcmp(e->op, "+") == 0 || strcmp(e->op, "-") == 0)
+            return tile_affine(e->left, loops, depth, body, scale, stride) &&
+                   tile_affine(e->right, loops, depth, body, strcmp(e->op, "-") == 0 ? -scale : scale, stride);
+        if (strcmp(e->op, "*") != 0) return 0;
+        if (e->right->type == NODE_NUMBER)
+            return tile_affine(e->left, loops, depth, body, scale * e->right->ival, stride);
+        if (e->left->type == NODE_NUMBER)
+            return tile_affine(e->right, loops, depth, body, scale * e->left->ival, stride);
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+// one iteration per element of a[f]: f affine in the counters, and taken
+// smallest stride first, each stride steps past every element the smaller
+// ones reach — i*C + j with C > the last j - first j
+static int tile_index_injective(Node *f, Node **loops, int depth, Node *body) {
+    long stride[MAX_NEST] = {0};
+    if (!tile_affine(f, loops, depth, body, 1, stride)) return 0;
+    int used[MAX_NEST] = {0};
+    long reach = 0;
+    for (int done = 0; done < depth; done++) {
+        int k = -1;
+        for (int m = 0; m < depth; m++)
+            if (!used[m] && (k < 0 || labs(stride[m]) < labs(stride[k]))) k = m;
+        used[k] = 1;
+        if (stride[k] == 0 || labs(stride[k]) <= reach) return 0;
+        if (done == depth - 1) break;
+        int range = get_loop_range(loops[k]->children[1], loops[k]->children[0]);
+        if (range < 0) return 0;
+        reach += labs(stride[k]) * range;
+    }
+    return 1;
+}
+
+// ptr arrays with a buffer of their own: `let a: ptr = alloc(n)` once, and
+// `a` is never copied, passed, returned or re-bound anywhere (free(a, n)
+// aside). a[...] is then the only way to reach that buffer
+static char alias_allocs[64][64];
+static int  alias_alloc_count = 0;
+static char alias_escaped[256][64];
+static int  alias_escaped_count = 0;
+
+static int alias_listed(char list[][64], int count, const char *name) {
+    for (int i = 0; i < count; i++)
+        if (strcmp(list[i], name) == 0) return 1;
+    return 0;
+}
+
+static void alias_escape(const char *name) {
+    if (alias_escaped_count < 256 && !alias_listed(alias_escaped, alias_escaped_count, name))
+        strncpy(alias_escaped[alias_escaped_count++], name, 63);
+}
+
+static void collect_alias_info(Node *n) {
+    if (!n) return;
+    switch (n->type) {
+    case NODE_ASSIGN:
+        if (n->right && n->right->type == NODE_ALLOC &&
+            !alias_listed(alias_allocs, alias_alloc_count, n->name) && alias_alloc_count < 64)
+            strncpy(alias_allocs[alias_alloc_count++], n->name, 63);
+        else
+            alias_escape(n->name);          // a second binding of the same name
+        break;
+    case NODE_ASSIGN_MULTI:
+        alias_escape(n->name);
+        alias_escape(n->sval);
+        break;
+    case NODE_REASSIGN: case NODE_IDENT: case NODE_ADDR:
+    case NODE_FOR: case NODE_FOR_IF:
+        alias_escape(n->name);
+        break;
+    case NODE_FN_DEF:
+        for (int i = 0; i < n->child_count; i++)
+            alias_escape(n->children[i]->name);
+        collect_alias_info(n->right);
+        return;
+    case NODE_FREE:                         // releases the buffer, keeps no copy
+        if (n->left->type != NODE_IDENT) collect_alias_info(n->left);
+        collect_alias_info(n->right);
+        return;
+    default:
+        break;
+    }
+    collect_alias_info(n->left);
+    collect_alias_info(n->right);
+    for (int i = 0; i < n->child_count; i++)
+        collect_alias_info(n->children[i]);
+}
+
+// 1 if no other array name can reach the storage behind `name` — a frame
+// array whose address never escapes, or a ptr with a buffer of its own
+static int alias_unique(const char *name) {
+    if (alias_listed(alias_escaped, alias_escaped_count, name)) return 0;
+    return var_dtype(name) != DTYPE_PTR || alias_listed(alias_allocs, alias_alloc_count, name);
+}
+
+// 1 if the tree stores to array `name`
+static int node_stores_array(Node *n, const char *name) {
+    if (!n) return 0;
+    if (n->type == NODE_ARRAY_ASSIGN && strcmp(n->name, name) == 0) return 1;
+    if (node_stores_array(n->left, name) || node_stores_array(n->right, name)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_stores_array(n->children[i], name)) return 1;
+    return 0;
+}
+
+// dependence check without a dependence analysis — every store must be
+//   a[f] = a[f] +/- e   (additive reduction: any order gives the same sum)
+//   a[f] = e            with f injective over the nest (one writer per element)
+//   s = s +/- e         scalar reduction, s read nowhere else
+//   t = e               where t is a let inside the body (per-iteration temp)
+// and an array that is stored to is only ever touched at that same index
+static int tile_deps_ok(Node *body, Node *n, Node **loops, int depth) {
+    if (!n) return 1;
+    if (n->type == NODE_ARRAY_ASSIGN) {
+        if (other_index(body, n->name, n->left)) return 0;
+        Node target = *n;
+        target.type = NODE_ARRAY_ACCESS;
+        if (!is_reduction(&target, n->right) && !tile_index_injective(n->left, loops, depth, body))
+            return 0;
+    }
+    if (n->type == NODE_REASSIGN) {
+        for (int k = 0; k < depth; k++)
+            if (strcmp(n->name, loops[k]->name) == 0) return 0;
+        int local = 0;
+        for (int i = 0; i < body->child_count; i++)
+            if (body->children[i]->type == NODE_ASSIGN &&
+                strcmp(body->children[i]->name, n->name) == 0) local = 1;
+        if (!local) {
+            Node target;
+            memset(&target, 0, sizeof(target));
+            target.type = NODE_IDENT;
+            strncpy(target.name, n->name, 63);
+            if (!is_reduction(&target, n->right)) return 0;
+            // each reduction reads s once — any other read sees a partial sum
+            int reductions = 0;
+            for (int i = 0; i < body->child_count; i++)
+                if (body->children[i]->type == NODE_REASSIGN &&
+                    strcmp(body->children[i]->name, n->name) == 0) reductions++;
+            if (node_count_uses(body, n->name) != reductions) return 0;
+        }
+    }
+    if (n->type == NODE_ASSIGN) {
+        for (int k = 0; k < depth; k++)
+            if (strcmp(n->name, loops[k]->name) == 0) return 0;
+    }
+    if (!tile_deps_ok(body, n->left, loops, depth) || !tile_deps_ok(body, n->right, loops, depth)) return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!tile_deps_ok(body, n->children[i], loops, depth)) return 0;
+    return 1;
+}
+
+// loop bound must be computable once before the nest
+static int tile_bound_ok(Node *e, Node **loops, int depth, Node *body) {
+    if (!e) return 1;
+    switch (e->type) {
+    case NODE_NUMBER:
+        return 1;
+    case NODE_IDENT:
+        for (int k = 0; k < depth; k++)
+            if (strcmp(e->name, loops[k]->name) == 0) return 0;
+        return !node_writes_var(body, e->name);
+    case NODE_BINOP:
+        if (strcmp(e->op, "+") != 0 && strcmp(e->op, "-") != 0 && strcmp(e->op, "*") != 0) return 0;
+        return tile_bound_ok(e->left, loops, depth, body) && tile_bound_ok(e->right, loops, depth, body);
+    case NODE_NEG:
+        return tile_bound_ok(e->right, loops, depth, body);
+    default:
+        return 0;
+    }
+}
+
+// distinct array names accessed in n, collected into names[]
+static int collect_arrays(Node *n, char names[][64], int count) {
+    if (!n) return count;
+    if (n->type == NODE_ARRAY_ACCESS || n->type == NODE_ARRAY_ASSIGN) {
+        int seen = 0;
+        for (int i = 0; i < count; i++)
+            if (strcmp(names[i], n->name) == 0) seen = 1;
+        if (!seen && count < 16) strncpy(names[count++], n->name, 63);
+    }
+    count = collect_arrays(n->left,  names, count);
+    count = collect_arrays(n->right, names, count);
+    for (int i = 0; i < n->child_count; i++)
+        count = collect_arrays(n->children[i], names, count);
+    return count;
+}
+
+// every stored array must be provably separate from each other array the
+// body touches — a ptr copy under another name would be read after the
+// tiled order already overwrote it
+static int tile_alias_ok(Node *body) {
+    char names[16][64];
+    int count = collect_arrays(body, names, 0);
+    for (int i = 0; i < count; i++) {
+        if (!node_stores_array(body, names[i])) continue;
+        for (int j = 0; j < count; j++)
+            if (j != i && !alias_unique(names[i]) && !alias_unique(names[j])) return 0;
+    }
+    return 1;
+}
+
+// a for whose body is exactly one for — a nest tiling could apply to
+static int is_nest(Node *n) {
+    Node *b = n->children[3];
+    return b->type == NODE_BLOCK && b->child_count == 1 && b->children[0]->type == NODE_FOR;
+}
+
+static int tile_missed(Node *n, const char *why) {
+    remark(n, "tile", 0, "not tiled: %s", why);
+    return 0;
+}
+
+// emit a tiled version of the nest rooted at n — returns 0 (nothing emitted)
+// if the nest isn't perfect, isn't safe to reorder, or wouldn't benefit
+static int gen_tiled_nest(Node *n) {
+    if (options.tile_size < 0) return is_nest(n) ? tile_missed(n, "disabled by --no-tile") : 0;
+
+    Node *loops[MAX_NEST];
+    int depth = 0;
+    Node *cur = n;
+    while (depth < MAX_NEST) {
+        Node *step = cur->children[2];
+        if (step->type != NODE_NUMBER || step->ival != 1)
+            return is_nest(n) ? tile_missed(n, "a step is not the constant 1") : 0;
+        loops[depth++] = cur;
+        if (!is_nest(cur)) break;
+        cur = cur->children[3]->children[0];
+    }
+    Node *body = loops[depth - 1]->children[3];
+    if (depth < 2 || body->type != NODE_BLOCK) return 0;
+    if (!tile_body_ok(body))
+        return tile_missed(n, "body calls out, transfers control or takes addresses");
+    if (!block_accesses_array(body, loops[depth - 1]->name))
+        return tile_missed(n, "innermost body indexes no array with its counter");
+    for (int k = 0; k < depth; k++) {
+        if (!tile_bound_ok(loops[k]->children[0], loops, depth, body) ||
+            !tile_bound_ok(loops[k]->children[1], loops, depth, body))
+            return tile_missed(n, "bounds depend on the nest or change in the body");
+        for (int m = 0; m < k; m++)
+            if (strcmp(loops[k]->name, loops[m]->name) == 0)
+                return tile_missed(n, "nested counters share a name");
+    }
+    if (!tile_deps_ok(body, body, loops, depth))
+        return tile_missed(n, "stores may depend on iteration order");
+    if (!tile_alias_ok(body))
+        return tile_missed(n, "a stored array may share memory with another array");
+
+    char names[16][64];
+    int arrays = collect_arrays(body, names, 0);
+    int tiles[MAX_NEST];
+    tile_sizes(depth, arrays, tiles);
+
+    // every level known to fit in one tile — nothing to gain
+    int fits = 1;
+    for (int k = 0; k < depth; k++) {
+        int range = get_loop_range(loops[k]->children[1], loops[k]->children[0]);
+        if (range < 0 || range >= tiles[k]) fits = 0;
+    }
+    if (fits) return tile_missed(n, "every level already fits in one tile");
+
+    char edges[MAX_NEST * 12] = "";
+    for (int k = 0; k < depth; k++)
+        snprintf(edges + strlen(edges), sizeof(edges) - strlen(edges), k ? "x%d" : "%d", tiles[k]);
+    remark(n, "tile", 1, "%d-deep nest tiled %s", depth, edges);
+
+    int var_off[MAX_NEST], start_off[MAX_NEST], lim_off[MAX_NEST];
+    int ctl_off[MAX_NEST], end_off[MAX_NEST], reg[MAX_NEST];
+    int lbl_ctl[MAX_NEST], lbl_pt[MAX_NEST];
+    int lbl_exit = new_label();
+
+    // bounds don't depend on the nest — evaluate all of them up front
+    for (int k = 0; k < depth; k++) {
+        var_off[k]   = add_var(loops[k]->name, DTYPE_INT);
+        start_off[k] = add_var("", DTYPE_INT);
+        lim_off[k]   = add_var("", DTYPE_INT);
+        ctl_off[k]   = add_var("", DTYPE_INT);
+        end_off[k]   = add_var("", DTYPE_INT);
+        gen_expr(loops[k]->children[0]);
+        emit_mem("mov ", start_off[k], ", rax");
+        gen_expr(loops[k]->children[1]);
+        emit_mem("mov ", lim_off[k], ", rax");
+    }
+    // any empty range — the body never runs. counters end as the untiled
+    // nest leaves them: the empty level at its start, outer ones past their limit
+    for (int k = 0; k < depth; k++) {
+        emit_mem("mov rax, ", start_off[k], "");
+        emit_mem("mov ", var_off[k], ", rax");
+        emit_mem("cmp rax, ", lim_off[k], "");
+        emit_jmp("jg", lbl_exit);
+        emit_mem("mov rax, ", lim_off[k], "");
+        emitln("add rax, 1");
+        emit_mem("mov ", var_off[k], ", rax");
+    }
+    // point loop counters get registers, innermost first; body is call-free
+    for (int k = depth - 1; k >= 0; k--) {
+        reg[k] = regalloc_assign(loops[k]->name, 1);
+        remark_counter(loops[k], reg[k], 0);
+    }
+
+    // tile loops: ctl_k walks start..limit in steps of T_k
+    for (int k = 0; k < depth; k++) {
+        emit_mem("mov rax, ", start_off[k], "");
+        emit_mem("mov ", ctl_off[k], ", rax");
+        lbl_ctl[k] = new_label();
+        emit_label(lbl_ctl[k]);
+    }
+    // point loops: i = ctl_k .. min(ctl_k + T_k - 1, limit)
+    // the two innermost ends stay in r14/r15, the rest in the frame
+    for (int k = 0; k < depth; k++) {
+        emit_mem("mov rax, ", ctl_off[k], "");
+        emit("add rax, ");
+        buf_write_int(out_buf, &out_cursor, tiles[k] - 1);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit_mem("cmp rax, ", lim_off[k], "");
+        emit_mem("cmovg rax, ", lim_off[k], "");
+        if      (k == depth - 1) emitln("mov r14, rax");
+        else if (k == depth - 2) emitln("mov r15, rax");
+        else                     emit_mem("mov ", end_off[k], ", rax");
+        if (reg[k] >= 0) {
+            emit("mov ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[reg[k]]);
+            buf_write_str(out_buf, &out_cursor, ", ");
+            write_mem(ctl_off[k]);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        } else {
+            emit_mem("mov rax, ", ctl_off[k], "");
+            emit_mem("mov ", var_off[k], ", rax");
+        }
+        lbl_pt[k] = new_label();
+        emit_label(lbl_pt[k]);
+    }
+
+    gen_stmt(body);
+
+    for (int k = depth - 1; k >= 0; k--) {
+        const char *end = k == depth - 1 ? "r14" : k == depth - 2 ? "r15" : NULL;
+        if (reg[k] >= 0) {
+            emit("add ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[reg[k]]);
+            buf_write_str(out_buf, &out_cursor, ", 1\n");
+            emit("cmp ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[reg[k]]);
+        } else {
+            emit_mem("mov rax, ", var_off[k], "");
+            emitln("add rax, 1");
+            emit_mem("mov ", var_off[k], ", rax");
+            emit("cmp rax");
+        }
+        buf_write_str(out_buf, &out_cursor, ", ");
+        if (end) buf_write_str(out_buf, &out_cursor, end);
+        else     write_mem(end_off[k]);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit_jmp("jle", lbl_pt[k]);
+    }
+    for (int k = depth - 1; k >= 0; k--) {
+        emit_mem("mov rax, ", ctl_off[k], "");
+        emit("add rax, ");
+        buf_write_int(out_buf, &out_cursor, tiles[k]);
+        buf_write_str(out_buf, &out_cursor, "\n");
+        emit_mem("mov ", ctl_off[k], ", rax");
+        emit_mem("cmp rax, ", lim_off[k], "");
+        emit_jmp("jle", lbl_ctl[k]);
+    }
+    // leave each loop var one past its limit, like the untiled loop
+    for (int k = 0; k < depth; k++) {
+        emit_mem("mov rax, ", lim_off[k], "");
+        emitln("add rax, 1");
+        emit_mem("mov ", var_off[k], ", rax");
+        regalloc_free(loops[k]->name);
+    }
+    emit_label(lbl_exit);
+    return 1;
+}
+
+// ─────────────────────────────────────────
+// Match lowering
+// a compare chain by default. dense constant cases use a jump table instead
+// ─────────────────────────────────────────
+#define MATCH_TABLE_MIN 4       // fewer cases than this stay a chain
+
+// every case value a literal, no two alike — safe to reorder or tabulate
+static int match_consts(Node *n) {
+    for (int i = 0; i < n->child_count; i++) {
+        Node *a = n->children[i]->left;
+        if (!a) continue;
+        if (a->type != NODE_NUMBER) return 0;
+        for (int j = 0; j < i; j++) {
+            Node *b = n->children[j]->left;
+            if (b && b->ival == a->ival) return 0;
+        }
+    }
+    return 1;
+}
+
+static void match_range(Node *n, long *lo, long *hi) {
+    *lo = 0; *hi = -1;
+    for (int i = 0; i < n->child_count; i++) {
+        Node *a = n->children[i]->left;
+        if (!a) continue;
+        if (*hi < *lo || a->ival < *lo) *lo = a->ival;
+        if (*hi < *lo || a->ival > *hi) *hi = a->ival;
+    }
+}
+
+// table when the values are dense — unless the profile has one case taking
+// 90% of the hits, where the hot-first chain is a predictable direct branch
+static int match_use_table(Node *n, int cases) {
+    if (cases < MATCH_TABLE_MIN) return 0;
+    long lo, hi;
+    match_range(n, &lo, &hi);
+    if (hi - lo + 1 > 2 * cases) return 0;
+    if (prof_data) {
+        long total = 0, top = 0;
+        for (int i = 0; i < n->child_count; i++) {
+            long c = prof_count(n->children[i], 0);
+            total += c;
+            if (c > top) top = c;
+        }
+        if (total && top * 10 >= total * 9) return 0;
+    }
+    return 1;
+}
+
+// index = subject - lo; one unsigned compare rejects both ends
+static void emit_match_table(Node *n, int subj, int *case_labels, int no_match) {
+    long lo, hi;
+    match_range(n, &lo, &hi);
+    int lbl_table = new_label();
+    emit_mem("mov rax, ", subj, "");
+    emit("mov rbx, ");
+    buf_write_int(out_buf, &out_cursor, lo);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emitln("sub rax, rbx");
+    emit("cmp rax, ");
+    buf_write_int(out_buf, &out_cursor, hi - lo);
+    buf_write_str(out_buf, &out_cursor, "\n");
+    emit_jmp("ja", no_match);
+    emit("lea rbx, [rel .L");
+    buf_write_int(out_buf, &out_cursor, lbl_table);
+    buf_write_str(out_buf, &out_cursor, "]\n");
+    emitln("jmp [rbx+rax*8]");
+    emitln("align 8");
+    emit_label(lbl_table);
+    for (long v = lo; v <= hi; v++) {
+        int target = no_match;
+        for (int i = 0; i < n->child_count; i++)
+            if (n->children[i]->left && n->children[i]->left->ival == v)
+                target = case_labels[i];
+        emit("dq .L");
+        buf_write_int(out_buf, &out_cursor, target);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+}
+
+// ─────────────────────────────────────────
+// If-conversion
+// `if c  x = a  else  x = b  end` (else optional) becomes x = select(c, a, b)
+// when both values are small and can't fault or have side effects, since
+// the arm not taken is evaluated too
+// ─────────────────────────────────────────
+#define IFCONV_MAX_NODES 8
+
+static int ifconv_value_ok(Node *n) {
+    if (!n) return 1;
+    switch (n->type) {
+    case NODE_NUMBER: case NODE_BOOL: case NODE_FLOAT: case NODE_IDENT:
+    case NODE_FIELD_ACCESS: case NODE_NEG: case NODE_BITNOT: case NODE_CAST:
+    case NODE_AND: case NODE_OR: case NODE_SELECT: case NODE_INTRINSIC:
+        break;
+    case NODE_BINOP:
+        if (strcmp(n->op, "/") == 0) return 0;      // may trap
+        break;
+    default:
+        return 0;                                   // loads, calls, I/O
+    }
+    if (!ifconv_value_ok(n->left) || !ifconv_value_ok(n->right)) return 0;
+    for (int i = 0; i < n->child_count; i++)
+        if (!ifconv_value_ok(n->children[i])) return 0;
+    return 1;
+}
+
+// the single `x = value` a branch body consists of, else NULL
+static Node *ifconv_assign(Node *body) {
+    if (body && body->type == NODE_BLOCK && body->child_count == 1) body = body->children[0];
+    if (!body || body->type != NODE_REASSIGN) return NULL;
+    if (node_size(body->right) > IFCONV_MAX_NODES || !ifconv_value_ok(body->right)) return NULL;
+    return body;
+}
+
+static int gen_if_converted(Node *n) {
+    if (n->child_count > 1) return 0;
+    if (n->child_count == 1 && n->children[0]->type != NODE_ELSE) return 0;
+    Node *t = ifconv_assign(n->right);
+    if (!t) return 0;
+    Node self;                          // no else: x keeps its value
+    Node *other = NULL;
+    if (n->child_count == 1) {
+        Node *e = ifconv_assign(n->children[0]->right);
+        if (!e || strcmp(e->name, t->name) != 0) return 0;
+        other = e->right;
+    } else {
+        memset(&self, 0, sizeof(self));
+        self.type = NODE_IDENT;
+        strncpy(self.name, t->name, 63);
+        other = &self;
+    }
+    DataType dt = var_dtype(t->name);
+    if (dt == DTYPE_STR) return 0;      // pointer + length — gen_select moves one word
+    gen_select(n->left, t->right, other, dt);
+    cse_invalidate(t->name);
+    emit("mov ");
+    write_mem(var_offset(t->name));
+    buf_write_str(out_buf, &out_cursor, ", rax\n");
+    return 1;
+}
+
+// ─────────────────────────────────────────
+// Loop-invariant code motion
+// pure invariant expressions and ptr array bases are computed once in the
+// loop preheader. innermost loops keep them in free registers, outer loops
+// (whose inner loops want the registers) in LICM_SLOTS frame slots
+// ─────────────────────────────────────────
+static char addr_taken[64][64];     // variables whose address escapes via addr()
+static int  addr_taken_count = 0;
+
+static void collect_addr_taken(Node *n) {
+    if (!n) return;
+    if (n->type == NODE_ADDR && addr_taken_count < 64)
+        strncpy(addr_taken[addr_taken_count++], n->name, 63);
+    collect_addr_taken(n->left);
+    collect_addr_taken(n->right);
+    for (int i = 0; i < n->child_count; i++)
+        collect_addr_taken(n->children[i]);
+}
+
+static int is_addr_taken(const char *name) {
+    for (int i = 0; i < addr_taken_count; i++)
+        if (strcmp(addr_taken[i], name) == 0) return 1;
+    return 0;
+}
+
+// returns 1 if the tree contains a node of the given type
+static int node_has_type(Node *n, NodeType type) {
+    if (!n) return 0;
+    if (n->type == type) return 1;
+    if (node_has_type(n->left, type) || node_has_type(n->right, type)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (node_has_type(n->children[i], type)) return 1;
+    return 0;
+}
+
+// returns 1 if the tree changes name — let, reassignment, field store,
+// multi-assign, or as a for-loop counter. element stores leave a ptr as is
+static int licm_writes(Node *n, const char *name) {
+    if (!n) return 0;
+    switch (n->type) {
+    case NODE_ASSIGN: case NODE_REASSIGN: case NODE_FIELD_ASSIGN:
+    case NODE_FOR: case NODE_FOR_IF:
+        if (strcmp(n->name, name) == 0) return 1;
+        break;
+    case NODE_ASSIGN_MULTI:
+        if (strcmp(n->name, name) == 0 || strcmp(n->sval, name) == 0) return 1;
+        break;
+    default:
+        break;
+    }
+    if (licm_writes(n->left, name) || licm_writes(n->right, name)) return 1;
+    for (int i = 0; i < n->child_count; i++)
+        if (licm_writes(n->children[i], name)) return 1;
+    return 0;
+}
+
+// 1 if name keeps its value for the whole loop — mem_writes = the loop may
+// store through a pointer (deref or a K call), which reaches addr()'d vars
+static int licm_var_ok(const char *name, Node *loop, int mem_writes) {
+    if (licm_writes(loop, name)) return 0;
+    return !(mem_writes && is_addr_taken(name));
+}
+
+// 1 if e has the same value on every iteration, no side effects and can't
+// fault — so it's safe to evaluate once ahead of the loop, even if the loop
+// would not have evaluated it. no memory reads, no division
+static int licm_invariant(Node *e, Node *loop, int mem_writes) {
+    switch (e->type) {
+    case NODE_NUMBER: case NODE_BOOL: case NODE_FLOAT:
+        return 1;
+    case NODE_CAST:
+        return licm_invariant(e->right, loop, mem_writes);
+    case NODE_IDENT: case NODE_FIELD_ACCESS:
+        return licm_var_ok(e->name, loop, mem_writes);
+    case NODE_BINOP:
+        if (strcmp(e->op, "/") == 0) return 0;
+        return licm_invariant(e->left, loop, mem_writes) &&
+               licm_invariant(e->right, loop, mem_writes);
+    case NODE_AND: case NODE_OR:
+        return licm_invariant(e->left, loop, mem_writes) &&
+               licm_invariant(e->right, loop, mem_writes);
+    case NODE_NEG: case NODE_BITNOT:
+        return licm_invariant(e->right, loop, mem_writes);
+    case NODE_INTRINSIC: case NODE_SELECT:
+        for (int i = 0; i < e->child_count; i++)
+            if (!licm_invariant(e->children[i], loop, mem_writes)) return 0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_hoisted(Node *e) {
+    for (int i = 0; i < hoist_count; i++)
+        if (hoists[i].expr == e) return 1;
+    return 0;
+}
 
-    case NODE_STRLEN:
-        gen_expr(n->right);             // string address → rax
-        emitln("mov rdi, rax");
-        emitln("call strlen");          // strlen(str) → rax
-        break;
+// collect maximal invariant non-leaf expressions under n
+static int licm_collect(Node *n, Node *loop, int mem_writes, Node **cands, int count) {
+    if (!n || count >= MAX_HOISTS) return count;
+    if ((n->type == NODE_BINOP  || n->type == NODE_NEG ||
+         n->type == NODE_AND    || n->type == NODE_OR  ||
+         n->type == NODE_BITNOT || n->type == NODE_INTRINSIC) && !is_hoisted(n) &&
+        licm_invariant(n, loop, mem_writes)) {
+        cands[count++] = n;
+        return count;
+    }
+    count = licm_collect(n->left,  loop, mem_writes, cands, count);
+    count = licm_collect(n->right, loop, mem_writes, cands, count);
+    for (int i = 0; i < n->child_count; i++)
+        count = licm_collect(n->children[i], loop, mem_writes, cands, count);
+    return count;
+}
 
-    default:
-        fprintf(stderr, "Codegen error: unexpected node in expression\n");
-        exit(1);
+// fill the next hoist entry with a fresh register, else a frame slot — 0 if
+// neither. the caller emits the value, then publishes it with hoist_count++
+static int licm_place(Node *expr, const char *name, int use_regs, int call_free, int *slots) {
+    if (hoist_count >= MAX_HOISTS) return 0;
+    Hoist *h = &hoists[hoist_count];
+    h->expr  = expr;
+    strncpy(h->name, name, 63);
+    snprintf(h->owner, sizeof(h->owner), "%%licm%d", hoist_count);
+    h->reg   = use_regs ? regalloc_assign(h->owner, call_free) : -1;
+    if (h->reg < 0) {
+        h->owner[0] = 0;
+        if (!expr || *slots >= LICM_SLOTS) return 0;   // a base in memory gains nothing
+        h->off = add_var("", DTYPE_INT);
+        (*slots)++;
     }
+    return 1;
 }
 
-static void emit_auto_free() {
-    for (int i = 0; i < var_count; i++) {
-        if (var_table[i].dtype == DTYPE_PTR && var_table[i].owned) {
-            emit("mov rdi, [rbp-");
-            buf_write_int(out_buf, &out_cursor, var_table[i].offset);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emitln("mov rsi, 1024");    // size — we store this later
-            emitln("mov rax, 11");      // munmap
-            emitln("syscall");
+static void licm_store(Hoist *h) {
+    if (h->reg >= 0) {
+        emit("mov ");
+        buf_write_str(out_buf, &out_cursor, alloc_regs[h->reg]);
+        buf_write_str(out_buf, &out_cursor, ", rax\n");
+    } else {
+        emit_mem("mov ", h->off, ", rax");
+    }
+}
+
+// emit the preheader for `loop` (cond and body are what runs each iteration)
+// — returns the hoist table mark to hand back to licm_end at loop exit
+static int licm_begin(Node *loop, Node *cond, Node *body) {
+    int mark       = hoist_count;
+    int calls_k    = node_calls_k_fn(cond) || node_calls_k_fn(body);
+    int call_free  = !node_has_call(cond) && !node_has_call(body);
+    int mem_writes = calls_k || node_has_type(loop, NODE_DEREF_ASSIGN) ||
+                     node_has_type(loop, NODE_MEMOP) || node_has_type(loop, NODE_IO) ||
+                     node_has_type(loop, NODE_XFER);
+    int use_regs   = !calls_k && !node_has_loop(body);
+    int slots      = 0;
+
+    // ptr array bases — innermost loops only
+    if (use_regs) {
+        char names[16][64];
+        int count = collect_arrays(cond, names, 0);
+        count     = collect_arrays(body, names, count);
+        for (int i = 0; i < count; i++) {
+            if (var_dtype(names[i]) != DTYPE_PTR || hoisted_base(names[i]) >= 0) continue;
+            if (iv_covers(cond, names[i]) && iv_covers(body, names[i])) continue;
+            if (!licm_var_ok(names[i], loop, mem_writes)) continue;
+            if (!licm_place(NULL, names[i], 1, call_free, &slots)) {
+                remark(loop, "licm", 0, "base of '%s' reloaded each iteration: no free registers", names[i]);
+                break;
+            }
+            remark(loop, "licm", 1, "base of '%s' kept in %s", names[i], alloc_regs[hoists[hoist_count].reg]);
+            emit("mov ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[hoists[hoist_count].reg]);
+            buf_write_str(out_buf, &out_cursor, ", ");
+            write_mem(var_offset(names[i]));
+            buf_write_str(out_buf, &out_cursor, "\n");
+            hoist_count++;
         }
     }
+
+    // invariant expressions — equal ones share one value
+    Node *cands[MAX_HOISTS];
+    int count = licm_collect(cond, loop, mem_writes, cands, 0);
+    count     = licm_collect(body, loop, mem_writes, cands, count);
+    for (int i = 0; i < count && hoist_count < MAX_HOISTS; i++) {
+        int shared = -1;
+        for (int j = 0; j < hoist_count; j++)
+            if (hoists[j].expr && node_equal(hoists[j].expr, cands[i])) shared = j;
+        if (shared >= 0) {
+            hoists[hoist_count] = hoists[shared];
+            hoists[hoist_count].expr     = cands[i];
+            hoists[hoist_count].owner[0] = 0;
+            hoist_count++;
+            continue;
+        }
+        if (!licm_place(cands[i], "", use_regs, call_free, &slots)) {
+            remark(cands[i], "licm", 0, "invariant expression left in the loop: no register or frame slot");
+            continue;
+        }
+        if (hoists[hoist_count].reg >= 0)
+            remark(cands[i], "licm", 1, "invariant expression hoisted into %s", alloc_regs[hoists[hoist_count].reg]);
+        else
+            remark(cands[i], "licm", 1, "invariant expression hoisted into a frame slot");
+        gen_expr(cands[i]);
+        licm_store(&hoists[hoist_count]);
+        hoist_count++;
+    }
+    return mark;
 }
 
+// loop exit — drop the loop's hoists and release their registers
+static void licm_end(int mark) {
+    for (int i = mark; i < hoist_count; i++)
+        if (hoists[i].owner[0]) regalloc_free(hoists[i].owner);
+    hoist_count = mark;
+}
 
-// returns 1 if node tree references variable name
-static int node_uses_var(Node *n, const char *varname) {
-    if (!n) return 0;
-    if (n->type == NODE_IDENT && strcmp(n->name, varname) == 0) return 1;
-    if (node_uses_var(n->left,  varname)) return 1;
-    if (node_uses_var(n->right, varname)) return 1;
+// collect candidate running pointers for accesses under n
+static void iv_collect(Node *n, Node *loop, int mem_writes, int call_free) {
+    if (!n) return;
+    if ((n->type == NODE_ARRAY_ACCESS || n->type == NODE_ARRAY_ASSIGN) &&
+        iv_ptr_count < MAX_IV_PTRS) {
+        int reg, disp;
+        Node *inv = NULL;
+        int scale = 0, c = 0;
+        DataType dt = var_dtype(n->name);
+        if (!iv_lookup(n, &reg, &disp) &&
+            iv_split(n->left, loop->name, &inv, &scale, &c) && scale != 0 &&
+            (!inv || licm_invariant(inv, loop, mem_writes)) &&
+            (dt != DTYPE_PTR || licm_var_ok(n->name, loop, mem_writes))) {
+            IvPtr *p = &iv_ptrs[iv_ptr_count];
+            snprintf(p->owner, sizeof(p->owner), "%%iv%d", iv_ptr_count);
+            p->reg = regalloc_assign(p->owner, call_free);
+            if (p->reg >= 0) {
+                strncpy(p->array, n->name, 63);
+                strncpy(p->var, loop->name, 63);
+                p->inv   = inv;
+                p->scale = scale;
+                p->elem  = dt == DTYPE_PTR ? 8 : -8;
+                p->bump  = p->elem * scale * loop->children[2]->ival;
+                iv_ptr_count++;
+            }
+        }
+    }
+    iv_collect(n->left,  loop, mem_writes, call_free);
+    iv_collect(n->right, loop, mem_writes, call_free);
     for (int i = 0; i < n->child_count; i++)
-        if (node_uses_var(n->children[i], varname)) return 1;
-    return 0;
+        iv_collect(n->children[i], loop, mem_writes, call_free);
+}
+
+// set up running pointers for the innermost for / for-where loop n, whose
+// counter already holds its start value — returns the mark for iv_end
+static int iv_begin(Node *n, Node *filter, int off, int loop_reg) {
+    int mark = iv_ptr_count;
+    Node *body = n->children[3];
+    if (n->children[2]->type != NODE_NUMBER) return mark;
+    if (node_has_loop(body) || node_calls_k_fn(body) || node_calls_k_fn(filter)) return mark;
+    if (!unroll_body_ok(body, n->name) || !unroll_body_ok(filter, n->name)) return mark;
+
+    int call_free  = !node_has_call(body) && !node_has_call(filter);
+    int mem_writes = node_has_type(n, NODE_DEREF_ASSIGN) || node_has_type(n, NODE_MEMOP) ||
+                     node_has_type(n, NODE_IO) || node_has_type(n, NODE_XFER);
+    iv_collect(filter, n, mem_writes, call_free);
+    iv_collect(body,   n, mem_writes, call_free);
+
+    // pointer = element scale*start + inv
+    for (int i = mark; i < iv_ptr_count; i++) {
+        IvPtr *p = &iv_ptrs[i];
+        const char *r = alloc_regs[p->reg];
+        if (loop_reg >= 0) {
+            emit("mov rax, ");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        } else {
+            emit_mem("mov rax, ", off, "");
+        }
+        if (p->scale != 1) {
+            emit("imul rax, rax, ");
+            buf_write_int(out_buf, &out_cursor, p->scale);
+            buf_write_str(out_buf, &out_cursor, "\n");
+        }
+        if (p->inv) {
+            emitln("push rax");
+            gen_expr(p->inv);
+            emitln("pop rbx");
+            emitln("add rax, rbx");
+        }
+        if (p->elem > 0) {
+            emit("mov ");
+            buf_write_str(out_buf, &out_cursor, r);
+            buf_write_str(out_buf, &out_cursor, ", ");
+            write_mem(var_offset(p->array));
+            buf_write_str(out_buf, &out_cursor, "\n");
+            emit("lea ");
+            buf_write_str(out_buf, &out_cursor, r);
+            buf_write_str(out_buf, &out_cursor, ", [");
+            buf_write_str(out_buf, &out_cursor, r);
+            buf_write_str(out_buf, &out_cursor, "+rax*8]\n");
+        } else {
+            // element k of a stack array sits at rbp - base - 8k
+            emitln("neg rax");
+            emit("lea ");
+            buf_write_str(out_buf, &out_cursor, r);
+            buf_write_str(out_buf, &out_cursor, ", [rbp+rax*8-");
+            buf_write_int(out_buf, &out_cursor, var_offset(p->array));
+            buf_write_str(out_buf, &out_cursor, "]\n");
+        }
+    }
+    return mark;
+}
+
+// loop exit — drop the loop's running pointers
+static void iv_end(int mark) {
+    for (int i = mark; i < iv_ptr_count; i++)
+        regalloc_free(iv_ptrs[i].owner);
+    iv_ptr_count = mark;
 }
 
 static void gen_stmt(Node *n) {
+    if (n->type != NODE_BLOCK) emit_line(n);
     switch (n->type) {
 
     case NODE_BLOCK:
@@ -666,9 +5143,27 @@ static void gen_stmt(Node *n) {
     case NODE_ARRAY_ASSIGN: {
         int base = var_offset(n->name);
         DataType dt = var_dtype(n->name);
-        if (dt == DTYPE_PTR) {
+        DataType elem = dt == DTYPE_PTR ? DTYPE_INT : dt;
+        int base_reg = dt == DTYPE_PTR ? hoisted_base(n->name) : -1;
+        int iv_reg, iv_disp;
+        if (iv_lookup(n, &iv_reg, &iv_disp)) {
+            // running pointer (IV strength reduction)
+            gen_as(n->right, elem);             // value → rax
+            emit("mov ");
+            write_iv_mem(iv_reg, iv_disp);
+            buf_write_str(out_buf, &out_cursor, ", rax\n");
+        } else if (base_reg >= 0) {
+            // base already in a register (LICM)
+            gen_as(n->right, elem);             // value → rax
+            emitln("push rax");
+            gen_expr(n->left);              // index → rax
+            emitln("pop rbx");
+            emit("mov [");
+            buf_write_str(out_buf, &out_cursor, alloc_regs[base_reg]);
+            buf_write_str(out_buf, &out_cursor, "+rax*8], rbx\n");
+        } else if (dt == DTYPE_PTR) {
             // pointer indexing write: ptr[i] = val
-            gen_expr(n->right);             // value → rax
+            gen_as(n->right, elem);             // value → rax
             emitln("push rax");             // save value
             emit("mov rax, [rbp-");         // load ptr
             buf_write_int(out_buf, &out_cursor, base);
@@ -685,7 +5180,7 @@ static void gen_stmt(Node *n) {
             emitln("mov [rax], rbx");       // store
         } else {
             // stack array write
-            gen_expr(n->right);
+            gen_as(n->right, elem);
             emitln("push rax");
             gen_expr(n->left);
             emitln("shl rax, 3");
@@ -715,7 +5210,7 @@ static void gen_stmt(Node *n) {
             }
             int base = add_var_struct(n->name, n->right->name, sd->field_count);
             for (int i = 0; i < n->right->child_count && i < sd->field_count; i++) {
-                gen_expr(n->right->children[i]);
+                gen_as(n->right->children[i], sd->fields[i].dtype);
                 emit("mov [rbp-");
                 buf_write_int(out_buf, &out_cursor, base + sd->fields[i].offset);
                 buf_write_str(out_buf, &out_cursor, "], rax\n");
@@ -723,17 +5218,16 @@ static void gen_stmt(Node *n) {
             break;
         }
         // regular variable assignment (int / float / bool / str)
+        // untyped lets the parser couldn't infer take the expression's type
+        if (n->dtype == DTYPE_UNKNOWN) {
+            n->dtype = expr_dtype(n->right);
+            if (n->dtype == DTYPE_UNKNOWN || n->dtype == DTYPE_STRUCT)
+                n->dtype = DTYPE_INT;
+        }
+        cse_invalidate(n->name);
         int off = add_var(n->name, n->dtype);
         if (n->dtype == DTYPE_FLOAT) {
-            if (n->right->type == NODE_NUMBER) {
-                emit("mov rax, ");
-                buf_write_int(out_buf, &out_cursor, n->right->ival);
-                buf_write_str(out_buf, &out_cursor, "\n");
-                emitln("cvtsi2sd xmm0, rax");
-            } else {
-                gen_expr(n->right);
-                emitln("movq xmm0, rax");
-            }
+            gen_fexpr(n->right);
             emit("movsd [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "], xmm0\n");
@@ -742,8 +5236,11 @@ static void gen_stmt(Node *n) {
             emit("mov byte [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "], al\n");
+        } else if (n->dtype == DTYPE_STR) {
+            gen_str(n->right);
+            store_str(off);
           } else {
-            gen_expr(n->right);
+            gen_as(n->right, n->dtype);
             emit("mov [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "], rax\n");
@@ -769,22 +5266,27 @@ static void gen_stmt(Node *n) {
             fprintf(stderr, "Codegen error: struct '%s' has no field '%s'\n", stype, n->sval);
             exit(1);
         }
-        gen_expr(n->right);
+        gen_as(n->right, ftype);
         emit("mov [rbp-");
         buf_write_int(out_buf, &out_cursor, base + foff);
         buf_write_str(out_buf, &out_cursor, "], rax\n");
         break;
     }
     case NODE_REASSIGN: {
-        gen_expr(n->right);
         int off      = var_offset(n->name);
         DataType dt  = var_dtype(n->name);
         if (dt == DTYPE_FLOAT) {
-            emitln("movq xmm0, rax");
+            gen_fexpr(n->right);
+            cse_invalidate(n->name);
             emit("movsd [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "], xmm0\n");
+        } else if (dt == DTYPE_STR) {
+            gen_str(n->right);
+            store_str(off);
         } else {
+            gen_as(n->right, dt);
+            cse_invalidate(n->name);
             emit("mov [rbp-");
             buf_write_int(out_buf, &out_cursor, off);
             buf_write_str(out_buf, &out_cursor, "], rax\n");
@@ -795,25 +5297,23 @@ static void gen_stmt(Node *n) {
     // ── print ──
     // detects type of expression and uses correct printf format
     case NODE_PRINT: {
-        gen_expr(n->right);
         // determine what type we're printing
-        int is_str   = (n->right->type == NODE_STRING) ||
-                       (n->right->type == NODE_IDENT &&
-                        var_dtype(n->right->name) == DTYPE_STR);
-        int is_float = (n->right->dtype == DTYPE_FLOAT) ||
-                       (n->right->type == NODE_IDENT &&
-                        var_dtype(n->right->name) == DTYPE_FLOAT);
-        int is_bool  = (n->right->type == NODE_BOOL) ||
-                       (n->right->type == NODE_IDENT &&
-                        var_dtype(n->right->name) == DTYPE_BOOL);
+        DataType pt  = expr_dtype(n->right);
+        int is_str   = pt == DTYPE_STR;
+        int is_float = pt == DTYPE_FLOAT;
+        if (is_float)    gen_fexpr(n->right);
+        else if (is_str) gen_str(n->right);
+        else             gen_expr(n->right);
+        int is_bool  = pt == DTYPE_BOOL;
         if (is_str) {
-            emitln("mov rsi, rax");
+            // %.*s — bounded by the length, so a slice prints without a NUL
+            emitln("mov rsi, rdx");
+            emitln("mov rdx, rax");
             emitln("lea rdi, [rel fmts]");
             emitln("xor rax, rax");
             emitln("call printf");
         } else if (is_float) {
-            // bits are in rax — move back to xmm0 for printf
-            emitln("movq xmm0, rax");
+            // value already in xmm0 — al = 1 vector register for printf
             emitln("lea rdi, [rel fmtf]");
             emitln("mov rax, 1");
             emitln("call printf");
@@ -837,33 +5337,49 @@ static void gen_stmt(Node *n) {
             emitln("xor rax, rax");
             emitln("call printf");
         }
+        cse_clear();
         break;
     }
 
     // ── if / elif / else ──
+    // unlikely(...) bodies, and the elif / else bodies of an if likely(...),
+    // go to .text.cold so the hot path falls straight through
     case NODE_IF: {
+        if (!n->hint && gen_if_converted(n)) {
+            remark(n, "ifconv", 1, "branch replaced by cmov");
+            break;
+        }
         int lbl_end = new_label();
-        int branch_labels[64];
-        for (int i = 0; i < n->child_count; i++) branch_labels[i] = new_label();
-
-        gen_expr(n->left);
-        emitln("test rax, rax");
-        if (n->child_count > 0) emit_jmp("jz", branch_labels[0]);
-        else                    emit_jmp("jz", lbl_end);
-        gen_stmt(n->right);
-        emit_jmp("jmp", lbl_end);
-
-        for (int i = 0; i < n->child_count; i++) {
-            emit_label(branch_labels[i]);
-            Node *branch = n->children[i];
-            if (branch->type == NODE_ELIF) {
-                gen_expr(branch->left);
-                emitln("test rax, rax");
-                if (i + 1 < n->child_count) emit_jmp("jz", branch_labels[i+1]);
-                else                         emit_jmp("jz", lbl_end);
+        emit_prof_inc(n, 0);
+        for (int k = 0; k <= n->child_count; k++) {
+            Node *branch = k ? n->children[k - 1] : n;
+            Node *cond   = branch->type == NODE_ELSE ? NULL : branch->left;
+            int   last   = k == n->child_count;
+            int   cold   = branch->hint < 0 || (k > 0 && n->hint > 0);
+            if (cold) {
+                int lbl_cold = new_label();
+                if (cond) {
+                    emit_jcc(gen_flags(cond), lbl_cold);
+                } else {
+                    emit_jmp("jmp", lbl_cold);
+                }
+                emit_cold_begin();
+                emit_label(lbl_cold);
+                emit_prof_inc(branch, k ? 0 : 1);
                 gen_stmt(branch->right);
                 emit_jmp("jmp", lbl_end);
-            } else if (branch->type == NODE_ELSE) {
+                emit_cold_end();
+            } else if (cond) {
+                int lbl_next = last ? lbl_end : new_label();
+                emit_jcc(cc_invert(gen_flags(cond)), lbl_next);
+                emit_prof_inc(branch, k ? 0 : 1);
+                gen_stmt(branch->right);
+                if (!last) {
+                    emit_jmp("jmp", lbl_end);
+                    emit_label(lbl_next);
+                }
+            } else {
+                emit_prof_inc(branch, 0);
                 gen_stmt(branch->right);
             }
         }
@@ -875,6 +5391,7 @@ static void gen_stmt(Node *n) {
     case NODE_WHILE: {
         int lbl_start = new_label();
         int lbl_end   = new_label();
+        int hoist_mark = licm_begin(n, n->left, n->right);
         loop_push(lbl_end, lbl_start);
         emit_label(lbl_start);
         gen_expr(n->left);
@@ -884,18 +5401,29 @@ static void gen_stmt(Node *n) {
         emit_jmp("jmp", lbl_start);
         emit_label(lbl_end);
         loop_pop();
+        licm_end(hoist_mark);
         break;
     }
 
     // ── for loop ──
     // condition at bottom (FIX 3), limit/step hoisted to r14/r15 (FIX 4)
+    // perfect nests over arrays are tiled instead (gen_tiled_nest)
     case NODE_FOR: {
+        if (gen_tiled_nest(n)) break;
+
         int lbl_body  = new_label();
         int lbl_check = new_label();
+        Node *body    = n->children[3];
+        // inner loops and K calls reuse r14/r15 and r12/r13 — then limit/step
+        // are read from the frame and the counter stays out of registers
+        int nested    = node_has_loop(body) || node_calls_k_fn(body);
 
         gen_expr(n->children[0]);                   // eval start
-        int off = add_var(n->name, DTYPE_INT);
-        int loop_reg = regalloc_assign(n->name);
+        int off      = add_var(n->name, DTYPE_INT);
+        int lim_off  = add_var("", DTYPE_INT);
+        int step_off = add_var("", DTYPE_INT);
+        int loop_reg = node_calls_k_fn(body) ? -1 : regalloc_assign(n->name, !node_has_call(body));
+        remark_counter(n, loop_reg, node_calls_k_fn(body));
         if (loop_reg >= 0) {
             // store in register
             emit("mov ");
@@ -912,161 +5440,43 @@ static void gen_stmt(Node *n) {
         }
 
         gen_expr(n->children[1]);                   // hoist limit → r14
-        emitln("mov r14, rax");
+        if (nested) emit_mem("mov ", lim_off, ", rax");
+        else        emitln("mov r14, rax");
 
         gen_expr(n->children[2]);                   // hoist step → r15
-        emitln("mov r15, rax");
+        if (nested) emit_mem("mov ", step_off, ", rax");
+        else        emitln("mov r15, rax");
 
         int lbl_for_end = new_label();
         int lbl_increment = new_label();
         loop_push(lbl_for_end, lbl_increment);
 
-        // loop tilingtect if we should tile this loop
-        int tile_size = 64;
-        int should_tile = 0;
-        int loop_range = get_loop_range(n->children[1], n->children[0]);
-        if (loop_range > 128 &&
-            n->children[2]->type == NODE_NUMBER &&
-            n->children[2]->ival == 1 &&
-            block_accesses_array(n->children[3], n->name)) {
-            should_tile = 1;
-        }
-
-        // loop invariant code motion
-        Node *body = n->children[3];
-        int hoisted[64] = {0};
-        if (body->type == NODE_BLOCK) {
-            for (int i = 0; i < body->child_count; i++) {
-                Node *stmt = body->children[i];
-                if (stmt->type == NODE_ASSIGN &&
-                    !node_uses_var(stmt->right, n->name)) {
-                    gen_stmt(stmt);
-                    hoisted[i] = 1;
-                }
-            }
-        }
-
-        if (should_tile) {
-            // tiled loop — outer iterates over blocks, inner over elements
-            int lbl_outer_body  = new_label();
-            int lbl_outer_check = new_label();
-            int lbl_inner_body  = new_label();
-            int lbl_inner_check = new_label();
-
-            // outer loop: block = start to limit step tile_size
-            // block var stored at off (reuse loop var slot)
-            emit_jmp("jmp", lbl_outer_check);
-            emit_label(lbl_outer_body);
-
-            // inner loop: i = block to min(block+tile_size, limit)
-            // compute inner limit = min(block + tile_size, r14)
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emit("add rax, ");
-            buf_write_int(out_buf, &out_cursor, tile_size);
-            buf_write_str(out_buf, &out_cursor, "\n");
-            emitln("cmp rax, r14");
-            emitln("cmovg rax, r14");       // min(block+tile, limit)
-            emitln("push rax");             // save inner limit
-
-            // inner loop variable — reuse a temp stack slot
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emitln("push rax");             // save inner start
-
-            emit_jmp("jmp", lbl_inner_check);
-            emit_label(lbl_inner_body);
-
-            // emit body with inner i on stack
-            if (body->type == NODE_BLOCK) {
-                for (int i = 0; i < body->child_count; i++) {
-                    if (hoisted[i]) continue;
-                    gen_stmt(body->children[i]);
-                }
-            } else {
-                gen_stmt(body);
-            }
-
-            // inner i++
-            emitln("mov rax, [rsp]");
-            emitln("add rax, 1");
-            emitln("mov [rsp], rax");
-
-            emit_label(lbl_inner_check);
-            emitln("mov rax, [rsp]");
-            emitln("cmp rax, [rsp+8]");
-            emit_jmp("jl", lbl_inner_body);
-
-            emitln("add rsp, 16");          // clean up inner limit + start
-
-            // outer block += tile_size
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emit("add rax, ");
-            buf_write_int(out_buf, &out_cursor, tile_size);
-            buf_write_str(out_buf, &out_cursor, "\n");
-            emit("mov [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "], rax\n");
-
-            emit_label(lbl_outer_check);
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emitln("cmp rax, r14");
-            emit_jmp("jl", lbl_outer_body);
-
-        } else {
-            emit_jmp("jmp", lbl_check);
-            emit_label(lbl_body);
-
-            if (body->type == NODE_BLOCK) {
-                for (int i = 0; i < body->child_count; i++) {
-                    if (hoisted[i]) continue;
-                    gen_stmt(body->children[i]);
-                }
-            } else {
-                gen_stmt(body);
-            }
+        int iv_mark    = iv_begin(n, NULL, off, loop_reg);
+        int hoist_mark = licm_begin(n, NULL, body);
+        emit_prof_inc(n, 0);
+        int factor = unroll_factor(n, NULL);
+        if (factor > 1)
+            gen_unrolled(n, NULL, off, loop_reg, nested, lim_off, factor);
 
-            emit_label(lbl_increment);
-            if (loop_reg >= 0) {
-                emit("add ");
-                buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
-                buf_write_str(out_buf, &out_cursor, ", r15\n");
-                emit("mov rax, ");
-                buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
-                buf_write_str(out_buf, &out_cursor, "\n");
-                emit("mov [rbp-");
-                buf_write_int(out_buf, &out_cursor, off);
-                buf_write_str(out_buf, &out_cursor, "], rax\n");
-            } else {
-                emit("mov rax, [rbp-");
-                buf_write_int(out_buf, &out_cursor, off);
-                buf_write_str(out_buf, &out_cursor, "]\n");
-                emitln("add rax, r15");
-                emit("mov [rbp-");
-                buf_write_int(out_buf, &out_cursor, off);
-                buf_write_str(out_buf, &out_cursor, "], rax\n");
-            }
+        emit_jmp("jmp", lbl_check);
+        emit_label(lbl_body);
+        emit_loop_prefetch(n, NULL);
+        emit_prof_inc(n, 1);
+        gen_stmt(body);
 
-            emit_label(lbl_check);
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emitln("cmp rax, r14");
-            emit_jmp("jle", lbl_body);
-        }  // end else (non-tiled)
+        emit_label(lbl_increment);
+        last_line = 0;                  // the latch belongs to the for line
+        emit_line(n);
+        iv_advance(n->name, 1);
+        emit_for_latch(off, loop_reg, nested, lim_off, step_off, lbl_check, lbl_body);
 
         regalloc_free(n->name);
+        licm_end(hoist_mark);
+        iv_end(iv_mark);
         emit_label(lbl_for_end);
         loop_pop();
         break;
     }
-          
 
     // ── function definition ──
     case NODE_FN_DEF: {
@@ -1078,15 +5488,28 @@ static void gen_stmt(Node *n) {
 
         const char *arg_regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 
-        // exact stack size: params + locals, aligned to 16
+        // exact stack size: params + locals, aligned to 16 — a str param is two slots
         int local_vars  = count_vars(n->right);
-        int total_bytes = (n->child_count + local_vars) * 8;
+        int param_slots = n->child_count;
+        for (int i = 0; i < n->child_count; i++)
+            if (n->children[i]->dtype == DTYPE_STR) param_slots++;
+        int total_bytes = (param_slots + local_vars) * 8;
         if (total_bytes % 16 != 0) total_bytes += 8;
         if (total_bytes == 0)      total_bytes  = 16;
+        if (options.instrument) {
+            total_bytes += 16;                      // caller's inst_child, entry TSC
+            inst_slot = total_bytes;
+            inst_fn   = find_fn(n->name) ? (int)(find_fn(n->name) - fn_table) : -1;
+        }
 
-        buf_write_str(out_buf, &out_cursor, "\nglobal ");
-        buf_write_str(out_buf, &out_cursor, n->name);
-        buf_write_str(out_buf, &out_cursor, "\n");
+        // never called in the profiled run — keep it out of the hot text
+        int cold_fn = prof_data && n->prof_id && prof_count(n, 0) == 0;
+        if (cold_fn) {
+            text_section = TEXT_COLD;
+            buf_write_str(out_buf, &out_cursor, text_section);
+        }
+
+        emit_fn_global(n->name);
         emit_named_label(n->name);
         emitln("push rbp");
         emitln("mov rbp, rsp");
@@ -1094,26 +5517,65 @@ static void gen_stmt(Node *n) {
         buf_write_int(out_buf, &out_cursor, total_bytes);
         buf_write_str(out_buf, &out_cursor, "\n");
 
+        // int params arrive in rdi, rsi, ... and float params in xmm0, xmm1, ...
+        int ints = 0, floats = 0;
         for (int i = 0; i < n->child_count; i++) {
-            stack_top += 8;
+            stack_top += n->children[i]->dtype == DTYPE_STR ? 16 : 8;
             param_table[i].offset = stack_top;
             param_table[i].dtype  = n->children[i]->dtype;
             strncpy(param_table[i].name, n->children[i]->name, 63);
             param_count++;
+            if (n->children[i]->dtype == DTYPE_FLOAT) {
+                emit("movsd [rbp-");
+                buf_write_int(out_buf, &out_cursor, stack_top);
+                buf_write_str(out_buf, &out_cursor, "], xmm");
+                buf_write_int(out_buf, &out_cursor, floats++);
+                buf_write_str(out_buf, &out_cursor, "\n");
+                continue;
+            }
+            if (ints + (n->children[i]->dtype == DTYPE_STR) >= 6) {
+                fprintf(stderr, "Codegen error: '%s' needs more than 6 int registers for its parameters\n", n->name);
+                exit(1);
+            }
+            if (n->children[i]->dtype == DTYPE_STR) {
+                emit("mov [rbp-");          // length — the slot above the pointer
+                buf_write_int(out_buf, &out_cursor, stack_top - 8);
+                buf_write_str(out_buf, &out_cursor, "], ");
+                buf_write_str(out_buf, &out_cursor, arg_regs[ints + 1]);
+                buf_write_str(out_buf, &out_cursor, "\n");
+            }
             emit("mov [rbp-");
             buf_write_int(out_buf, &out_cursor, stack_top);
             buf_write_str(out_buf, &out_cursor, "], ");
-            buf_write_str(out_buf, &out_cursor, arg_regs[i]);
+            buf_write_str(out_buf, &out_cursor, arg_regs[ints++]);
             buf_write_str(out_buf, &out_cursor, "\n");
+            if (n->children[i]->dtype == DTYPE_STR) ints++;
         }
 
+        // self tail calls land here with fresh args already in the param slots
+        if (inst_fn >= 0) emit_inst_enter();
+        strncpy(cur_fn, n->name, 63);
+        cur_fn_ret   = n->dtype;
+        cur_fn_entry = new_label();
+        emit_label(cur_fn_entry);
+        emit_prof_inc(n, 0);
+        emit_inst_call();
+
         gen_stmt(n->right);
         emit_auto_free();
         emitln("xor rax, rax");
-        emitln("mov rsp, rbp");
-        emitln("pop rbp");
-        emitln("ret");
-
+        if (n->dtype == DTYPE_STR) emitln("xor edx, edx");    // empty str
+        emit_epilogue();
+        emit_fn_end();
+
+        inst_fn      = -1;
+        cur_fn[0]    = 0;
+        cur_fn_ret   = DTYPE_INT;
+        cur_fn_entry = -1;
+        if (cold_fn) {
+            text_section = TEXT_HOT;
+            buf_write_str(out_buf, &out_cursor, text_section);
+        }
         var_count = saved_var_count;
         stack_top = saved_stack_top;
         param_count = 0;
@@ -1123,10 +5585,10 @@ static void gen_stmt(Node *n) {
 
     // ── return ──
     case NODE_RETURN:
-        gen_expr(n->right);
-        emitln("mov rsp, rbp");
-        emitln("pop rbp");
-        emitln("ret");
+        if (n->right->type == NODE_FN_CALL && gen_tail_call(n->right)) break;
+        if (cur_fn_ret == DTYPE_STR) gen_str(n->right);    // rax:rdx
+        else gen_as(n->right, cur_fn_ret);      // a float result stays in xmm0 too
+        emit_epilogue();
         break;
 
     // ── standalone function call ──
@@ -1149,26 +5611,45 @@ static void gen_stmt(Node *n) {
                 else_label = case_labels[i];
         }
 
-        // emit compare chain — eval subject once into r13, compare each case
+        // eval subject once into a frame slot (r13 may hold a loop counter)
         gen_expr(n->left);
-        emitln("mov r13, rax");      // subject stays in r13
+        int subj = add_var("", DTYPE_INT);
+        emit_mem("mov ", subj, ", rax");
+        int no_match = else_label >= 0 ? else_label : lbl_end;
+
+        // distinct constant cases can be tested in any order — hottest first
+        int order[64], cases = 0;
+        for (int i = 0; i < n->child_count; i++)
+            if (n->children[i]->left) order[cases++] = i;
+        int consts = match_consts(n);
+        for (int i = 1; consts && prof_data && i < cases; i++)
+            for (int j = i; j > 0 && prof_count(n->children[order[j]], 0) >
+                                     prof_count(n->children[order[j - 1]], 0); j--) {
+                int t = order[j]; order[j] = order[j - 1]; order[j - 1] = t;
+            }
 
-        for (int i = 0; i < n->child_count; i++) {
-            Node *c = n->children[i];
-            if (c->left == NULL) continue;   // skip else here, handle at bottom
-            gen_expr(c->left);               // case value → rax
-            emitln("cmp r13, rax");
-            emit_jmp("je", case_labels[i]);
+        if (consts && match_use_table(n, cases)) {
+            remark(n, "match", 1, "%d cases lowered to a jump table", cases);
+            emit_match_table(n, subj, case_labels, no_match);
+        } else {
+            if (cases >= MATCH_TABLE_MIN)
+                remark(n, "match", 0, "compare chain: %s", !consts ? "case values are not constants" :
+                       prof_data ? "values too sparse or one case dominates the profile" : "values too sparse");
+            // compare chain
+            for (int j = 0; j < cases; j++) {
+                gen_expr(n->children[order[j]]->left);     // case value → rax
+                emit_mem("cmp rax, ", subj, "");
+                emit_jmp("je", case_labels[order[j]]);
+            }
+            // no case matched — jump to else if exists, else to end
+            emit_jmp("jmp", no_match);
         }
 
-        // no case matched — jump to else if exists, else to end
-        if (else_label >= 0) emit_jmp("jmp", else_label);
-        else                  emit_jmp("jmp", lbl_end);
-
         // emit each case body
         for (int i = 0; i < n->child_count; i++) {
             Node *c = n->children[i];
             emit_label(case_labels[i]);
+            emit_prof_inc(c, 0);
             gen_stmt(c->right);         // case body
             emit_jmp("jmp", lbl_end);
         }
@@ -1186,21 +5667,61 @@ static void gen_stmt(Node *n) {
         buf_write_int(out_buf, &out_cursor, off);
         buf_write_str(out_buf, &out_cursor, "]\n");
         emitln("mov [rax], rbx");       // write value to address
+        cse_clear();                    // may have written any addr()'d variable
         break;
     }
 
 
+    // prefetch(ptr, i, hint) — hint for the line holding ptr[i]
+    case NODE_PREFETCH: {
+        gen_expr(n->left);              // ptr → rax
+        if (n->right->type == NODE_NUMBER && n->right->ival >= 0) {
+            emit(prefetch_instr[n->ival]);
+            buf_write_str(out_buf, &out_cursor, " [rax+");
+            buf_write_int(out_buf, &out_cursor, n->right->ival * 8);
+            buf_write_str(out_buf, &out_cursor, "]\n");
+        } else {
+            emitln("push rax");
+            gen_expr(n->right);         // index → rax
+            emitln("pop rbx");
+            emit(prefetch_instr[n->ival]);
+            buf_write_str(out_buf, &out_cursor, " [rbx+rax*8]\n");
+        }
+        break;
+    }
+
   // free(ptr, size) — munmap syscall
     case NODE_FREE: {
         gen_expr(n->left);              // ptr → rax
         emitln("mov rdi, rax");         // addr
         gen_expr(n->right);             // size → rax
         emitln("mov rsi, rax");         // size
+        if (options.trace_alloc) {
+            emitln("call k_trace_free");    // the header has the real size
+            cse_clear();
+            break;
+        }
         emitln("mov rax, 11");          // syscall 11 = munmap
         emitln("syscall");
+        cse_clear();
         break;
     }
 
+    // copy(dst, src, n) / fill(dst, b, n)
+    case NODE_MEMOP:
+        gen_memop(n);
+        break;
+
+    // submit_read / submit_write / wait_completions as statements
+    case NODE_IO:
+        gen_io(n);
+        break;
+
+    // readv / writev / copy_file as statements
+    case NODE_XFER:
+        gen_xfer(n);
+        break;
+
     // read(fd, buf, size) — syscall 0
     case NODE_READ: {
         gen_expr(n->children[0]);       // fd → rax
@@ -1211,11 +5732,24 @@ static void gen_stmt(Node *n) {
         emitln("mov rdx, rax");         // size
         emitln("mov rax, 0");           // syscall 0 = read
         emitln("syscall");
+        cse_clear();
         break;
     }
 
     // write(fd, buf, size) — syscall 1
+    // write(fd, s) takes the size from the str
     case NODE_WRITE: {
+        if (n->child_count == 2) {
+            gen_expr(n->children[0]);   // fd → rax
+            emitln("push rax");
+            gen_str(n->children[1]);    // pointer → rax, length → rdx
+            emitln("mov rsi, rax");     // buf
+            emitln("pop rdi");          // fd
+            emitln("mov rax, 1");       // syscall 1 = write
+            emitln("syscall");
+            cse_clear();
+            break;
+        }
         gen_expr(n->children[0]);       // fd → rax
         emitln("mov rdi, rax");         // fd
         gen_expr(n->children[1]);       // buf → rax
@@ -1224,15 +5758,27 @@ static void gen_stmt(Node *n) {
         emitln("mov rdx, rax");         // size
         emitln("mov rax, 1");           // syscall 1 = write
         emitln("syscall");
+        cse_clear();
         break;
     }
 
+    // unmap(s) — munmap(pointer, length)
+    case NODE_UNMAP:
+        gen_str(n->left);               // pointer → rax, length → rdx
+        emitln("mov rdi, rax");
+        emitln("mov rsi, rdx");
+        emitln("mov rax, 11");          // syscall 11 = munmap
+        emitln("syscall");
+        cse_clear();
+        break;
+
     // close(fd) — syscall 3
     case NODE_CLOSE: {
         gen_expr(n->left);              // fd → rax
         emitln("mov rdi, rax");         // fd
         emitln("mov rax, 3");           // syscall 3 = close
         emitln("syscall");
+        cse_clear();
         break;
     }
 
@@ -1243,15 +5789,15 @@ static void gen_stmt(Node *n) {
         gen_expr(n->children[1]);       // second value → rax
         emitln("mov rdx, rax");         // second → rdx
         emitln("pop rax");              // first → rax
-        emitln("mov rsp, rbp");
-        emitln("pop rbp");
-        emitln("ret");
+        emit_epilogue();
         break;
     }
 
     // let lo, hi = fn() — rax has first, rdx has second
     case NODE_ASSIGN_MULTI: {
         gen_expr(n->right);             // call fn — rax=first, rdx=second
+        cse_invalidate(n->name);
+        cse_invalidate(n->sval);
         emitln("push rdx");             // save second
         int off1 = add_var(n->name, DTYPE_INT);
         emit("mov [rbp-");
@@ -1268,6 +5814,7 @@ static void gen_stmt(Node *n) {
     case NODE_DO_WHILE: {
         int lbl_start = new_label();
         int lbl_end   = new_label();
+        int hoist_mark = licm_begin(n, n->left, n->right);
         loop_push(lbl_end, lbl_start);
         emit_label(lbl_start);
         gen_stmt(n->right);
@@ -1276,6 +5823,7 @@ static void gen_stmt(Node *n) {
         emit_jmp("jnz", lbl_start);
         emit_label(lbl_end);
         loop_pop();
+        licm_end(hoist_mark);
         break;
     }
 
@@ -1284,10 +5832,17 @@ static void gen_stmt(Node *n) {
         int lbl_body  = new_label();
         int lbl_check = new_label();
         int lbl_increment = new_label();
+        Node *body    = n->children[3];
+        int calls_k   = node_calls_k_fn(body) || node_calls_k_fn(n->left);
+        int nested    = node_has_loop(body) || calls_k;
 
         gen_expr(n->children[0]);                   // start
-        int off = add_var(n->name, DTYPE_INT);
-        int loop_reg = regalloc_assign(n->name);
+        int off      = add_var(n->name, DTYPE_INT);
+        int lim_off  = add_var("", DTYPE_INT);
+        int step_off = add_var("", DTYPE_INT);
+        int loop_reg = calls_k ? -1 :
+                       regalloc_assign(n->name, !node_has_call(body) && !node_has_call(n->left));
+        remark_counter(n, loop_reg, calls_k);
         if (loop_reg >= 0) {
             emit("mov ");
             buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
@@ -1298,54 +5853,45 @@ static void gen_stmt(Node *n) {
         buf_write_str(out_buf, &out_cursor, "], rax\n");
 
         gen_expr(n->children[1]);                   // limit → r14
-        emitln("mov r14, rax");
+        if (nested) emit_mem("mov ", lim_off, ", rax");
+        else        emitln("mov r14, rax");
         gen_expr(n->children[2]);                   // step → r15
-        emitln("mov r15, rax");
+        if (nested) emit_mem("mov ", step_off, ", rax");
+        else        emitln("mov r15, rax");
 
-        emit_jmp("jmp", lbl_check);
         int lbl_for_if_end = new_label();
         loop_push(lbl_for_if_end, lbl_increment);
+        int iv_mark    = iv_begin(n, n->left, off, loop_reg);
+        int hoist_mark = licm_begin(n, n->left, body);
+        emit_prof_inc(n, 0);
+        int factor = unroll_factor(n, n->left);
+        if (factor > 1)
+            gen_unrolled(n, n->left, off, loop_reg, nested, lim_off, factor);
+
+        emit_jmp("jmp", lbl_check);
         emit_label(lbl_body);
+        emit_loop_prefetch(n, n->left);
+        emit_prof_inc(n, 1);
 
         // check filter condition — skip body if false
         gen_expr(n->left);
         emitln("test rax, rax");
         int lbl_skip = new_label();
         emit_jmp("jz", lbl_skip);
-        gen_stmt(n->children[3]);                   // body
+        gen_stmt(body);                             // body
         emit_label(lbl_skip);
 
         // increment 
         emit_label(lbl_increment);
-        if (loop_reg >= 0) {
-            emit("add ");
-            buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
-            buf_write_str(out_buf, &out_cursor, ", r15\n");
-            emit("mov rax, ");
-            buf_write_str(out_buf, &out_cursor, alloc_regs[loop_reg]);
-            buf_write_str(out_buf, &out_cursor, "\n");
-            emit("mov [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "], rax\n");
-        } else {
-            emit("mov rax, [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "]\n");
-            emitln("add rax, r15");
-            emit("mov [rbp-");
-            buf_write_int(out_buf, &out_cursor, off);
-            buf_write_str(out_buf, &out_cursor, "], rax\n");
-        }
-
-        emit_label(lbl_check);
-        emit("mov rax, [rbp-");
-        buf_write_int(out_buf, &out_cursor, off);
-        buf_write_str(out_buf, &out_cursor, "]\n");
-        emitln("cmp rax, r14");
-        emit_jmp("jle", lbl_body);
+        last_line = 0;                  // the latch belongs to the for line
+        emit_line(n);
+        iv_advance(n->name, 1);
+        emit_for_latch(off, loop_reg, nested, lim_off, step_off, lbl_check, lbl_body);
         emit_label(lbl_for_if_end);
         loop_pop();
         regalloc_free(n->name);
+        licm_end(hoist_mark);
+        iv_end(iv_mark);
         break;
     }
 
@@ -1367,10 +5913,10 @@ static void gen_stmt(Node *n) {
 // Entry point
 // ─────────────────────────────────────────
 void generate(Node *root, const char *out_file) {
-    out_cursor  = 0;
-    str_cursor  = 0;
+    stream_open(out_file);
     label_count = 0;
     str_count   = 0;
+    memset(str_slots, 0, sizeof(str_slots));
     var_count   = 0;
     stack_top   = 0;
     param_count = 0;
@@ -1378,12 +5924,62 @@ void generate(Node *root, const char *out_file) {
     regalloc_clear();
 
     loop_depth = 0;
+    hoist_count      = 0;
+    addr_taken_count = 0;
+    last_line        = 0;
+    ta_site_count    = 0;
+    remark_count     = 0;
+    remarks_out      = NULL;
+    if (options.remarks) {
+        remarks_out = options.remarks[0] ? fopen(options.remarks, "w") : stderr;
+        if (!remarks_out) {
+            fprintf(stderr, "Codegen error: cannot open remarks file '%s'\n", options.remarks);
+            exit(1);
+        }
+    }
+    collect_addr_taken(root);
+    alias_alloc_count   = 0;
+    alias_escaped_count = 0;
+    collect_alias_info(root);
+
+    // register every top-level function so calls can see their signatures
+    fn_count     = 0;
+    cur_fn[0]    = 0;
+    cur_fn_ret   = DTYPE_INT;
+    cur_fn_entry = -1;
+    inst_fn      = -1;
+    flt_count    = 0;
+    scan_used    = 0;
+    mem_used     = 0;
+    map_used     = 0;
+    io_used      = 0;
+    xfer_used    = 0;
+    for (int i = 0; i < root->child_count && fn_count < 256; i++) {
+        Node *fn = root->children[i];
+        if (fn->type != NODE_FN_DEF) continue;
+        strncpy(fn_table[fn_count].name, fn->name, 63);
+        fn_table[fn_count].param_count = fn->child_count;
+        fn_table[fn_count].ret         = fn->dtype;
+        for (int j = 0; j < fn->child_count && j < 64; j++)
+            fn_table[fn_count].param_types[j] = fn->children[j]->dtype;
+        fn_count++;
+    }
+
+    // profile-guided optimization — number the tree, then read counts back
+    prof_n       = 0;
+    prof_data    = NULL;
+    text_section = TEXT_HOT;
+    if (options.profile_generate || options.profile_use) prof_number(root);
+    if (options.profile_use) {
+        prof_load(options.profile_use);
+        if (prof_data) prof_apply_hints(root);
+    }
 
     // .data section — format strings
     emit_str("section .data\n");
     emit_str("    fmt      db \"%ld\", 10, 0\n");   // int format
     emit_str("    fmtf     db \"%g\",  10, 0\n");   // float format
-    emit_str("    fmts     db \"%s\",  10, 0\n");   // string format
+    emit_str("    fmts     db \"%.*s\", 10, 0\n");  // string format — length, pointer
     emit_str("    str_true  db \"true\",  10, 0\n"); // bool true
     emit_str("    str_false db \"false\", 10, 0\n"); // bool false
     emit_str("\n");
@@ -1392,7 +5988,11 @@ void generate(Node *root, const char *out_file) {
     emit_str("section .text\n");
     emit_str("    extern printf\n");
     emit_str("    extern strlen\n");
-    emit_str("    global main\n\n");
+    if (options.profile_generate || options.instrument || options.trace_alloc)
+        emit_str("    extern atexit\n    extern fopen\n    extern fprintf\n    extern fclose\n");
+    if (options.instrument || options.trace_alloc)
+        emit_str("    extern qsort\n    extern stderr\n");
+    emit_str("\n");
 
     // emit all function definitions first
     for (int i = 0; i < root->child_count; i++)
@@ -1407,31 +6007,74 @@ void generate(Node *root, const char *out_file) {
     int main_bytes = main_vars * 8;
     if (main_bytes % 16 != 0) main_bytes += 8;
     if (main_bytes == 0)      main_bytes  = 16;
+    if (options.instrument) {
+        main_bytes += 16;
+        inst_slot = main_bytes;
+    }
 
-    emit_str("\nmain:\n");
+    emit_fn_global("main");
+    emit_str("main:\n");
     emitln("push rbp");
     emitln("mov rbp, rsp");
     emit("sub rsp, ");
     buf_write_int(out_buf, &out_cursor, main_bytes);
     buf_write_str(out_buf, &out_cursor, "\n");
+    if (options.profile_generate) {
+        emitln("lea rdi, [rel k_prof_dump]");     // counts are written at exit
+        emitln("call atexit");
+    }
+    if (options.instrument) {
+        emitln("lea rdi, [rel k_inst_dump]");     // report is printed at exit
+        emitln("call atexit");
+        inst_fn = fn_count;                       // main's row
+        emit_inst_enter();
+        emit_inst_call();
+    }
+    if (options.trace_alloc) {
+        emitln("lea rdi, [rel k_trace_dump]");    // heap summary at exit
+        emitln("call atexit");
+    }
 
     for (int i = 0; i < root->child_count; i++)
         if (root->children[i]->type != NODE_FN_DEF)
             gen_stmt(root->children[i]);
 
     emitln("xor rax, rax");
-    emitln("mov rsp, rbp");
-    emitln("pop rbp");
-    emitln("ret");
-
-    // append collected string literals into a second .data section
-    if (str_cursor > 0) {
-        buf_write_str(out_buf, &out_cursor, "\nsection .data\n");
-        buf_write_str(out_buf, &out_cursor, str_buf);
+    emit_epilogue();
+    emit_fn_end();
+    inst_fn = -1;
+    if (options.profile_generate) emit_prof_runtime();
+    if (options.instrument)       emit_inst_runtime(fn_count + 1);
+    if (options.trace_alloc)      emit_ta_runtime();
+    if (scan_used)                emit_scan_helpers();
+    if (mem_used)                 emit_mem_helpers();
+    if (map_used)                 emit_map_file();
+    if (io_used)                  emit_io_runtime();
+    if (xfer_used)                emit_copy_file();
+
+    if (options.profile_generate) {
+        buf_write_str(out_buf, &out_cursor, "\nsection .bss\n    prof_counts resq ");
+        buf_write_int(out_buf, &out_cursor, prof_n ? prof_n : 1);
+        buf_write_str(out_buf, &out_cursor, "\n");
+    }
+    if (options.trace_alloc) {
+        buf_write_str(out_buf, &out_cursor, "\nsection .bss\n    ta_ring resq ");
+        buf_write_int(out_buf, &out_cursor, TA_RING * 4);
+        buf_write_str(out_buf, &out_cursor, "\n");
     }
 
-    if (buf_flush(out_buf, out_cursor, out_file) != 0) {
-        fprintf(stderr, "Codegen error: failed to write output file\n");
-        exit(1);
+    if (io_used) {
+        buf_write_str(out_buf, &out_cursor, "\nsection .bss\n    io_res resq ");
+        buf_write_int(out_buf, &out_cursor, IO_ENTRIES);
+        buf_write_str(out_buf, &out_cursor, "\n");
     }
+
+    if (remarks_out && remarks_out != stderr) fclose(remarks_out);
+    remarks_out = NULL;
+
+    emit_str_literals();
+
+    // float constants and runtime tables go last, in a second .data section
+    if (str_cursor > 0 || str_spill) emit_str("\nsection .data\n");
+    stream_close();
 }
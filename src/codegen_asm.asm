@@ -9,175 +9,227 @@
 
 section .text
 
+; ============================================================
+; Writers store whole 16-byte chunks, so they may write up to
+; 32 bytes past the new cursor — buffers carry that much slack.
+; The byte at the new cursor is always set to 0, so a buffer
+; that is only ever appended to stays a C string.
+; ============================================================
+
 ; ============================================================
 ; buf_write_str(char *buf, size_t *cursor, const char *str)
 ;   rdi = output buffer base
 ;   rsi = pointer to cursor (current write position)
 ;   rdx = null-terminated string to write
 ;
-; Copies str into buf[*cursor], advances *cursor by length
+; Copies str into buf[*cursor], advances *cursor by length.
+; 16 bytes per step: pcmpeqb finds the terminator in the chunk
 ; ============================================================
 global buf_write_str
 buf_write_str:
-    push    rbx
-    push    r12
-    push    r13
+    mov     rax, [rsi]          ; rax = current cursor value
+    lea     rdi, [rdi + rax]    ; rdi = destination
+    mov     r8, rdx             ; r8  = start of str
+    pxor    xmm1, xmm1
+
+.chunk:
+    mov     ecx, edx
+    and     ecx, 4095
+    cmp     ecx, 4096 - 16
+    ja      .byte               ; a 16-byte load could touch the next page
+
+    movdqu  xmm0, [rdx]
+    movdqu  [rdi], xmm0         ; copy the chunk, terminator and all
+    pcmpeqb xmm0, xmm1
+    pmovmskb ecx, xmm0
+    test    ecx, ecx
+    jnz     .tail
+    add     rdx, 16
+    add     rdi, 16
+    jmp     .chunk
+
+.tail:
+    bsf     ecx, ecx            ; ecx = index of the terminator
+    add     rdx, rcx
+    jmp     .done
 
-    mov     r12, rdi            ; r12 = buf base
-    mov     r13, rsi            ; r13 = cursor ptr
-    mov     rbx, rdx            ; rbx = str ptr
+.byte:
+    movzx   ecx, byte [rdx]     ; step to the page boundary a byte at a time
+    mov     [rdi], cl
+    test    cl, cl
+    jz      .done
+    inc     rdx
+    inc     rdi
+    jmp     .chunk
 
-    mov     rax, [r13]          ; rax = current cursor value
+.done:
+    sub     rdx, r8             ; rdx = length
+    add     rax, rdx
+    mov     [rsi], rax          ; update cursor
+    ret
 
-.copy_loop:
-    movzx   ecx, byte [rbx]    ; load next char
-    test    cl, cl
-    jz      .done               ; null terminator
+; ============================================================
+; buf_write_mem(char *buf, size_t *cursor, const char *ptr, size_t len)
+;   rdi = output buffer base
+;   rsi = pointer to cursor
+;   rdx = bytes to write (need not be null-terminated)
+;   rcx = length
+;
+; Copies len bytes into buf[*cursor], advances *cursor by len.
+; Large blocks use rep movsb, the rest 16-byte moves with one
+; overlapping final chunk
+; ============================================================
+global buf_write_mem
+buf_write_mem:
+    mov     rax, [rsi]
+    lea     rdi, [rdi + rax]    ; rdi = destination
+    add     rax, rcx
+    mov     [rsi], rax          ; cursor += len
+    lea     r8, [rdi + rcx]     ; r8  = end of destination
+
+    cmp     rcx, 512
+    jae     .movsb
+    cmp     rcx, 16
+    jb      .small
+
+    movdqu  xmm1, [rdx + rcx - 16]   ; last 16 bytes
+.loop16:
+    movdqu  xmm0, [rdx]
+    movdqu  [rdi], xmm0
+    add     rdx, 16
+    add     rdi, 16
+    sub     rcx, 16
+    cmp     rcx, 16
+    ja      .loop16
+    movdqu  [r8 - 16], xmm1
+    jmp     .done
 
-    mov     [r12 + rax], cl    ; buf[cursor] = char
-    inc     rax
-    inc     rbx
-    jmp     .copy_loop
+.small:
+    test    rcx, rcx
+    jz      .done
+.loop1:
+    movzx   eax, byte [rdx]
+    mov     [rdi], al
+    inc     rdx
+    inc     rdi
+    dec     rcx
+    jnz     .loop1
+    jmp     .done
 
-.done:
-    mov     [r13], rax          ; update cursor
+.movsb:
+    mov     rsi, rdx
+    rep     movsb
 
-    pop     r13
-    pop     r12
-    pop     rbx
+.done:
+    mov     byte [r8], 0        ; keep the buffer terminated
     ret
 
 ; ============================================================
 ; buf_write_int(char *buf, size_t *cursor, long val)
 ;   rdi = output buffer base
 ;   rsi = pointer to cursor
-;   rdx = integer value to write as decimal string
+;   rdx = integer value to write as signed decimal
 ;
-; Converts val to decimal and appends to buf
+; Converts val to decimal and appends to buf. Two digits per
+; step from digit_pairs; x / 100 is a multiply by its reciprocal
 ; ============================================================
 global buf_write_int
 buf_write_int:
-    push    rbx
-    push    r12
-    push    r13
-    push    r14
-    push    r15
-
-    mov     r12, rdi            ; r12 = buf base
-    mov     r13, rsi            ; r13 = cursor ptr
-    mov     r14, rdx            ; r14 = value
-
-    ; use stack as temp digit buffer (max 20 digits for 64-bit)
-    sub     rsp, 24
-    lea     r15, [rsp + 23]     ; r15 = end of temp buffer
-    mov     byte [r15], 0
-    dec     r15
-
-    ; handle zero
-    test    r14, r14
-    jnz     .convert
-
-    mov     byte [r15], '0'
-    dec     r15
-    jmp     .write
-
-.convert:
-    test    r14, r14
-    jz      .write
-
-    mov     rax, r14
-    xor     edx, edx
-    mov     rcx, 10
-    div     rcx                 ; rax = quotient, rdx = remainder
-    mov     r14, rax
-
-    add     dl, '0'
-    mov     [r15], dl
-    dec     r15
-    jmp     .convert
-
-.write:
-    inc     r15                 ; r15 now points to first digit
-
-    mov     rax, [r13]          ; rax = cursor
-
-.write_loop:
-    movzx   ecx, byte [r15]
-    test    cl, cl
-    jz      .int_done
-
-    mov     [r12 + rax], cl
-    inc     rax
-    inc     r15
-    jmp     .write_loop
-
-.int_done:
-    mov     [r13], rax          ; update cursor
-
-    add     rsp, 24
-    pop     r15
-    pop     r14
-    pop     r13
-    pop     r12
-    pop     rbx
+    mov     r8, [rsi]           ; r8 = cursor
+    mov     rax, rdx
+    test    rax, rax
+    jns     .positive
+    mov     byte [rdi + r8], '-'
+    inc     r8
+    neg     rax                 ; LONG_MIN stays 2^63 — right as unsigned
+
+.positive:
+    sub     rsp, 40             ; digits fill [rsp, rsp+32) from the top
+    lea     r9, [rsp + 32]      ; r9 = first digit written so far
+    lea     r11, [rel digit_pairs]
+
+.pairs:
+    cmp     rax, 100
+    jb      .last
+    mov     r10, rax            ; r10 = x
+    shr     rax, 2
+    mov     rdx, 0x28F5C28F5C28F5C3
+    mul     rdx
+    mov     rax, rdx
+    shr     rax, 2              ; rax = x / 100
+    imul    rcx, rax, 100
+    sub     r10, rcx            ; r10 = x % 100
+    movzx   ecx, word [r11 + r10*2]
+    sub     r9, 2
+    mov     [r9], cx
+    jmp     .pairs
+
+.last:
+    cmp     rax, 10
+    jb      .one
+    movzx   ecx, word [r11 + rax*2]
+    sub     r9, 2
+    mov     [r9], cx
+    jmp     .copy
+.one:
+    add     al, '0'
+    dec     r9
+    mov     [r9], al
+
+.copy:
+    lea     rcx, [rsp + 32]
+    sub     rcx, r9             ; rcx = digit count, 1..20
+    movdqu  xmm0, [r9]          ; reads past the digits stay in our frame
+    movdqu  xmm1, [r9 + 16]
+    add     rdi, r8             ; rdi = destination
+    movdqu  [rdi], xmm0
+    movdqu  [rdi + 16], xmm1
+    mov     byte [rdi + rcx], 0
+    add     r8, rcx
+    mov     [rsi], r8           ; update cursor
+
+    add     rsp, 40
     ret
 
 ; ============================================================
-; buf_flush(char *buf, size_t len, const char *filename)
-;   rdi = buffer
-;   rsi = length
-;   rdx = filename (null-terminated)
+; buf_flush(int fd, const char *buf, size_t len)
+;   rdi = file descriptor
+;   rsi = buffer
+;   rdx = length
 ;
-; Opens file, writes buffer in one syscall, closes.
+; Writes all len bytes — short writes continue where they
+; stopped, EINTR is retried.
 ; Returns 0 on success, -1 on error.
 ; ============================================================
 global buf_flush
 buf_flush:
-    push    rbx
-    push    r12
-    push    r13
-    push    r14
-
-    mov     r12, rdi            ; r12 = buffer
-    mov     r13, rsi            ; r13 = length
-    mov     r14, rdx            ; r14 = filename
-
-    ; sys_open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)
-    mov     rax, 2              ; sys_open
-    mov     rdi, r14
-    mov     rsi, 0x241          ; O_WRONLY | O_CREAT | O_TRUNC
-    mov     rdx, 0644o
-    syscall
-
-    cmp     rax, 0
-    jl      .open_fail
-
-    mov     rbx, rax            ; rbx = fd
-
-    ; sys_write(fd, buf, len)
-    mov     rax, 1
-    mov     rdi, rbx
-    mov     rsi, r12
-    mov     rdx, r13
-    syscall
-
-    ; sys_close(fd)
-    mov     rax, 3
-    mov     rdi, rbx
+.write:
+    test    rdx, rdx
+    jz      .ok
+    mov     eax, 1              ; sys_write(fd, buf, len)
     syscall
+    cmp     rax, -4             ; -EINTR
+    je      .write
+    test    rax, rax
+    jle     .fail               ; error, or no progress
+    add     rsi, rax
+    sub     rdx, rax
+    jmp     .write
 
+.ok:
     xor     eax, eax            ; return 0 = success
-    jmp     .done
+    ret
 
-.open_fail:
+.fail:
     mov     eax, -1
-
-.done:
-    pop     r14
-    pop     r13
-    pop     r12
-    pop     rbx
     ret
 
+section .rodata
+digit_pairs:                    ; "00" "01" ... "99"
+    db      "0001020304050607080910111213141516171819"
+    db      "2021222324252627282930313233343536373839"
+    db      "4041424344454647484950515253545556575859"
+    db      "6061626364656667686970717273747576777879"
+    db      "8081828384858687888990919293949596979899"
 
 section .note.GNU-stack noalloc noexec nowrite progbits
@@ -6,16 +6,22 @@
 
 Token tokens[MAX_TOKENS];
 int   token_count = 0;
+static int line = 1;    // current source line, stamped on each token
 
-static void add_token(TokenType type, const char *value) {
+// the token is the len bytes at start — a slice of the source, not a copy
+static void add_token(TokenType type, const char *start, long len) {
     if (token_count >= MAX_TOKENS) {
         fprintf(stderr, "Lexer error: too many tokens\n");
         exit(1);
     }
-    tokens[token_count].type = type;
-    strncpy(tokens[token_count].value, value, 63);
-    tokens[token_count].value[63] = 0;
-    token_count++;
+    Token *t = &tokens[token_count++];
+    int    n = len < 63 ? (int)len : 63;
+    t->type  = type;
+    t->line  = line;
+    t->start = start;
+    t->len   = (int)len;
+    memcpy(t->value, start, n);
+    t->value[n] = 0;
 }
 
 static int is_keyword(const char *s, TokenType *out) {
@@ -55,20 +61,50 @@ static int is_keyword(const char *s, TokenType *out) {
     if (strcmp(s, "and")      == 0) { *out = TOK_AND;      return 1; }
     if (strcmp(s, "or")       == 0) { *out = TOK_OR;       return 1; }
     if (strcmp(s, "strlen")   == 0) { *out = TOK_STRLEN;   return 1; }
+    if (strcmp(s, "len")      == 0) { *out = TOK_STRLEN;   return 1; }   // same node
     if (strcmp(s, "where") == 0) { *out = TOK_WHERE; return 1; }
+    if (strcmp(s, "unroll")   == 0) { *out = TOK_UNROLL;   return 1; }
+    if (strcmp(s, "prefetch") == 0) { *out = TOK_PREFETCH; return 1; }
+    if (strcmp(s, "popcnt")   == 0) { *out = TOK_POPCNT;   return 1; }
+    if (strcmp(s, "lzcnt")    == 0) { *out = TOK_LZCNT;    return 1; }
+    if (strcmp(s, "tzcnt")    == 0) { *out = TOK_TZCNT;    return 1; }
+    if (strcmp(s, "bswap")    == 0) { *out = TOK_BSWAP;    return 1; }
+    if (strcmp(s, "min")      == 0) { *out = TOK_MIN;      return 1; }
+    if (strcmp(s, "max")      == 0) { *out = TOK_MAX;      return 1; }
+    if (strcmp(s, "abs")      == 0) { *out = TOK_ABS;      return 1; }
+    if (strcmp(s, "sqrt")     == 0) { *out = TOK_SQRT;     return 1; }
+    if (strcmp(s, "select")   == 0) { *out = TOK_SELECT;   return 1; }
+    if (strcmp(s, "likely")   == 0) { *out = TOK_LIKELY;   return 1; }
+    if (strcmp(s, "unlikely") == 0) { *out = TOK_UNLIKELY; return 1; }
+    if (strcmp(s, "find")        == 0) { *out = TOK_FIND;        return 1; }
+    if (strcmp(s, "find_byte")   == 0) { *out = TOK_FIND_BYTE;   return 1; }
+    if (strcmp(s, "count_byte")  == 0) { *out = TOK_COUNT_BYTE;  return 1; }
+    if (strcmp(s, "split_lines") == 0) { *out = TOK_SPLIT_LINES; return 1; }
+    if (strcmp(s, "copy")        == 0) { *out = TOK_COPY;        return 1; }
+    if (strcmp(s, "fill")        == 0) { *out = TOK_FILL;        return 1; }
+    if (strcmp(s, "compare")     == 0) { *out = TOK_COMPARE;     return 1; }
+    if (strcmp(s, "map_file")    == 0) { *out = TOK_MAP_FILE;    return 1; }
+    if (strcmp(s, "unmap")       == 0) { *out = TOK_UNMAP;       return 1; }
+    if (strcmp(s, "submit_read")      == 0) { *out = TOK_SUBMIT_READ;      return 1; }
+    if (strcmp(s, "submit_write")     == 0) { *out = TOK_SUBMIT_WRITE;     return 1; }
+    if (strcmp(s, "wait_completions") == 0) { *out = TOK_WAIT_COMPLETIONS; return 1; }
+    if (strcmp(s, "readv")            == 0) { *out = TOK_READV;            return 1; }
+    if (strcmp(s, "writev")           == 0) { *out = TOK_WRITEV;           return 1; }
+    if (strcmp(s, "copy_file")        == 0) { *out = TOK_COPY_FILE;        return 1; }
     return 0;
 }
 
-void tokenize(const char *src) {
-    int i = 0;
-    int len = strlen(src);
+void tokenize(const char *src, long len) {
+    long i = 0;
     token_count = 0;
+    line        = 1;
 
     while (i < len) {
         char c = src[i];
 
         // skip whitespace and newlines
         if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if (c == '\n') line++;
             i++;
             continue;
         }
@@ -79,74 +115,79 @@ void tokenize(const char *src) {
             continue;
         }
 
-        // number
+        // number — digits '.' digits [e[+-]digits] makes it a float
         if (isdigit(c)) {
-            char buf[64];
-            int  j = 0;
-            while (i < len && isdigit(src[i]))
-                buf[j++] = src[i++];
-            buf[j] = 0;
-            add_token(TOK_NUMBER, buf);
+            long start    = i;
+            int  is_float = 0;
+            while (i < len && isdigit(src[i])) i++;
+            if (i + 1 < len && src[i] == '.' && isdigit(src[i+1])) {
+                is_float = 1;
+                i++;
+                while (i < len && isdigit(src[i])) i++;
+                if (i < len && (src[i] == 'e' || src[i] == 'E')) {
+                    i++;
+                    if (i < len && (src[i] == '+' || src[i] == '-')) i++;
+                    while (i < len && isdigit(src[i])) i++;
+                }
+            }
+            add_token(is_float ? TOK_FLOAT : TOK_NUMBER, src + start, i - start);
             continue;
         }
 
         // identifier or keyword
         if (isalpha(c) || c == '_') {
-            char buf[64];
-            int  j = 0;
-            while (i < len && (isalnum(src[i]) || src[i] == '_'))
-                buf[j++] = src[i++];
-            buf[j] = 0;
+            long start = i;
+            while (i < len && (isalnum(src[i]) || src[i] == '_')) i++;
+            add_token(TOK_IDENT, src + start, i - start);
+            Token *t = &tokens[token_count - 1];
             TokenType kw;
-            if (is_keyword(buf, &kw))
-                add_token(kw, buf);
-            else
-                add_token(TOK_IDENT, buf);
+            if (is_keyword(t->value, &kw)) t->type = kw;
             continue;
         }
 
         // string literal
         if (c == '"') {
-            char buf[256];
-            int  j = 0;
-            i++;    // skip opening quote
-            while (i < len && src[i] != '"' && j < 255) {
-                buf[j++] = src[i++];
-            }
+            long start = ++i;   // skip opening quote
+            while (i < len && src[i] != '"') i++;
+            add_token(TOK_STRING, src + start, i - start);
             if (i < len) i++;   // skip closing quote
-            buf[j] = 0;
-            add_token(TOK_STRING, buf);
             continue;
         }
 
         // two-char operators
         if (i + 1 < len) {
             char next = src[i+1];
-            if (c == '=' && next == '=') { add_token(TOK_EQEQ, "=="); i += 2; continue; }
-            if (c == '!' && next == '=') { add_token(TOK_NEQ,  "!="); i += 2; continue; }
-            if (c == '>' && next == '=') { add_token(TOK_GTE,  ">="); i += 2; continue; }
-            if (c == '<' && next == '=') { add_token(TOK_LTE,  "<="); i += 2; continue; }
-            if (c == '-' && next == '>') { add_token(TOK_ARROW, "->"); i += 2; continue; }
+            if (c == '=' && next == '=') { add_token(TOK_EQEQ,  src + i, 2); i += 2; continue; }
+            if (c == '!' && next == '=') { add_token(TOK_NEQ,   src + i, 2); i += 2; continue; }
+            if (c == '>' && next == '=') { add_token(TOK_GTE,   src + i, 2); i += 2; continue; }
+            if (c == '<' && next == '=') { add_token(TOK_LTE,   src + i, 2); i += 2; continue; }
+            if (c == '-' && next == '>') { add_token(TOK_ARROW, src + i, 2); i += 2; continue; }
+            if (c == '<' && next == '<') { add_token(TOK_SHL,   src + i, 2); i += 2; continue; }
+            if (c == '>' && next == '>') { add_token(TOK_SHR,   src + i, 2); i += 2; continue; }
         }
 
         // single-char operators and delimiters
         switch (c) {
-            case '=': add_token(TOK_EQ,     "=");  break;
-            case '+': add_token(TOK_PLUS,   "+");  break;
-            case '-': add_token(TOK_MINUS,  "-");  break;
-            case '*': add_token(TOK_STAR,   "*");  break;
-            case '/': add_token(TOK_SLASH,  "/");  break;
-            case '>': add_token(TOK_GT,     ">");  break;
-            case '<': add_token(TOK_LT,     "<");  break;
-            case '(': add_token(TOK_LPAREN, "(");  break;
-            case ')': add_token(TOK_RPAREN, ")");  break;
-            case ',': add_token(TOK_COMMA,    ",");  break;
-            case ':': add_token(TOK_COLON,    ":");  break;
-            case '[': add_token(TOK_LBRACKET, "[");  break;
-            case ']': add_token(TOK_RBRACKET, "]");  break;
-            case '{': add_token(TOK_LBRACE,   "{");  break;
-            case '}': add_token(TOK_RBRACE,   "}");  break;
-            case '.': add_token(TOK_DOT,      ".");  break;
+            case '=': add_token(TOK_EQ,     src + i, 1); break;
+            case '+': add_token(TOK_PLUS,   src + i, 1); break;
+            case '-': add_token(TOK_MINUS,  src + i, 1); break;
+            case '*': add_token(TOK_STAR,   src + i, 1); break;
+            case '/': add_token(TOK_SLASH,  src + i, 1); break;
+            case '>': add_token(TOK_GT,     src + i, 1); break;
+            case '<': add_token(TOK_LT,     src + i, 1); break;
+            case '&': add_token(TOK_AMP,    src + i, 1); break;
+            case '|': add_token(TOK_PIPE,   src + i, 1); break;
+            case '^': add_token(TOK_CARET,  src + i, 1); break;
+            case '~': add_token(TOK_TILDE,  src + i, 1); break;
+            case '(': add_token(TOK_LPAREN, src + i, 1); break;
+            case ')': add_token(TOK_RPAREN, src + i, 1); break;
+            case ',': add_token(TOK_COMMA,    src + i, 1); break;
+            case ':': add_token(TOK_COLON,    src + i, 1); break;
+            case '[': add_token(TOK_LBRACKET, src + i, 1); break;
+            case ']': add_token(TOK_RBRACKET, src + i, 1); break;
+            case '{': add_token(TOK_LBRACE,   src + i, 1); break;
+            case '}': add_token(TOK_RBRACE,   src + i, 1); break;
+            case '.': add_token(TOK_DOT,      src + i, 1); break;
             default:
                 fprintf(stderr, "Lexer error: unknown character '%c'\n", c);
                 exit(1);
@@ -154,5 +195,5 @@ void tokenize(const char *src) {
         i++;
     }
 
-    add_token(TOK_EOF, "");
+    add_token(TOK_EOF, src + len, 0);
 }
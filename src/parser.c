@@ -43,6 +43,7 @@ Node *new_node(NodeType type) {
     Node *n = &node_pool[node_count++];
     memset(n, 0, sizeof(Node));
     n->type = type;
+    n->line = tokens[cursor > 0 ? cursor - 1 : 0].line;    // last consumed token
     return n;
 }
 
@@ -72,6 +73,10 @@ static Token *expect(TokenType type, const char *msg) {
 static Node *parse_statement();
 static Node *parse_expression();
 static Node *parse_comparison();
+static Node *parse_bitxor();
+static Node *parse_bitand();
+static Node *parse_shift();
+static Node *parse_additive();
 static Node *parse_term();
 static Node *parse_factor();
 static Node *parse_block_body();
@@ -105,12 +110,42 @@ static DataType parse_type_annotation() {
 // ─────────────────────────────────────────
 // Infer type from expression node
 // ─────────────────────────────────────────
+// DTYPE_UNKNOWN when it depends on variable types — codegen resolves those
 static DataType infer_type(Node *expr) {
     if (!expr) return DTYPE_UNKNOWN;
     if (expr->type == NODE_NUMBER)      return DTYPE_INT;
+    if (expr->type == NODE_FLOAT)       return DTYPE_FLOAT;
     if (expr->type == NODE_STRING)      return DTYPE_STR;
+    if (expr->type == NODE_SLICE)       return DTYPE_STR;
+    if (expr->type == NODE_MAP_FILE)    return DTYPE_STR;
     if (expr->type == NODE_BOOL)        return DTYPE_BOOL;
     if (expr->type == NODE_STRUCT_INIT) return DTYPE_STRUCT;
+    if (expr->type == NODE_NEG)         return infer_type(expr->right);
+    if (expr->type == NODE_INTRINSIC && expr->dtype == DTYPE_UNKNOWN) {
+        // min / max / abs follow their arguments
+        DataType t = DTYPE_INT;
+        for (int i = 0; i < expr->child_count; i++) {
+            DataType c = infer_type(expr->children[i]);
+            if (c == DTYPE_FLOAT) return DTYPE_FLOAT;
+            if (c != DTYPE_INT)   t = DTYPE_UNKNOWN;
+        }
+        return t;
+    }
+    if (expr->type == NODE_SELECT) {
+        DataType a = infer_type(expr->children[1]), b = infer_type(expr->children[2]);
+        if (a == DTYPE_FLOAT || b == DTYPE_FLOAT) return DTYPE_FLOAT;
+        return a == b ? a : DTYPE_UNKNOWN;
+    }
+    if (expr->type == NODE_BINOP) {
+        if (strchr("+-*/", expr->op[0]) == NULL) return DTYPE_INT;    // comparison
+        DataType l = infer_type(expr->left), r = infer_type(expr->right);
+        if (l == DTYPE_FLOAT || r == DTYPE_FLOAT) return DTYPE_FLOAT;
+        if (l == DTYPE_INT && r == DTYPE_INT)     return DTYPE_INT;
+        return DTYPE_UNKNOWN;
+    }
+    if (expr->type == NODE_IDENT || expr->type == NODE_FN_CALL ||
+        expr->type == NODE_ARRAY_ACCESS || expr->type == NODE_FIELD_ACCESS)
+        return DTYPE_UNKNOWN;
     if (expr->dtype != DTYPE_UNKNOWN)   return expr->dtype;
     return DTYPE_INT;
 }
@@ -151,6 +186,11 @@ static long eval_comptime(Node *n) {
                 if (r == 0) { fprintf(stderr, "comptime error: division by zero\n"); exit(1); }
                 return l / r;
             }
+            if (strcmp(n->op, "&")  == 0) return l & r;
+            if (strcmp(n->op, "|")  == 0) return l | r;
+            if (strcmp(n->op, "^")  == 0) return l ^ r;
+            if (strcmp(n->op, "<<") == 0) return l << (r & 63);
+            if (strcmp(n->op, ">>") == 0) return l >> (r & 63);
             fprintf(stderr, "comptime error: unsupported op '%s'\n", n->op);
             exit(1);
         }
@@ -160,6 +200,23 @@ static long eval_comptime(Node *n) {
     }
 }
 
+// ─────────────────────────────────────────
+// Branch condition: cond | likely(cond) | unlikely(cond)
+// the hint only changes code layout — codegen moves cold bodies out of line
+// ─────────────────────────────────────────
+static Node *parse_branch_cond(int *hint) {
+    *hint = 0;
+    if ((peek()->type == TOK_LIKELY || peek()->type == TOK_UNLIKELY) &&
+        peek2()->type == TOK_LPAREN) {
+        *hint = advance()->type == TOK_LIKELY ? 1 : -1;
+        advance();
+        Node *cond = parse_comparison();
+        expect(TOK_RPAREN, ")");
+        return cond;
+    }
+    return parse_comparison();
+}
+
 // ─────────────────────────────────────────
 // Parse block body — stops at elif/else/end
 // ─────────────────────────────────────────
@@ -189,9 +246,55 @@ static Node *parse_block() {
 // ─────────────────────────────────────────
 // Parse single statement
 // ─────────────────────────────────────────
+// name(a, b, c) for the three-argument builtins below — ival = the TOK_ kind
+// copy(dst, src, n), fill(dst, byte, n), compare(a, b, n) — n is in bytes
+// readv(fd, iov, count), writev(fd, iov, count), copy_file(in, out, n)
+static Node *parse_builtin3(NodeType type) {
+    Token *t = advance();
+    expect(TOK_LPAREN, "(");
+    Node *n = new_node(type);
+    n->ival = t->type;
+    strncpy(n->name, t->value, 63);
+    for (int i = 0; i < 3; i++) {
+        if (i) expect(TOK_COMMA, ",");
+        n->children[n->child_count++] = parse_expression();
+    }
+    expect(TOK_RPAREN, ")");
+    n->dtype = DTYPE_INT;
+    return n;
+}
+
+// submit_read / submit_write(fd, buf, n [, offset]) → ticket
+// wait_completions(results) → completions, results[ticket] = bytes or -errno
+static Node *parse_io() {
+    Token *t = advance();
+    expect(TOK_LPAREN, "(");
+    Node *n = new_node(NODE_IO);
+    n->ival = t->type;
+    strncpy(n->name, t->value, 63);
+    int args = t->type == TOK_WAIT_COMPLETIONS ? 1 : 3;
+    for (int i = 0; i < args; i++) {
+        if (i) expect(TOK_COMMA, ",");
+        n->children[n->child_count++] = parse_expression();
+    }
+    if (args == 3 && peek()->type == TOK_COMMA) {
+        advance();
+        n->children[n->child_count++] = parse_expression();    // offset
+    }
+    expect(TOK_RPAREN, ")");
+    n->dtype = DTYPE_INT;
+    return n;
+}
+
 static Node *parse_statement() {
     Token *t = peek();
 
+    // copy / fill are statements, compare is an expression; the I/O
+    // builtins are both — their result is often dropped
+    if (t->type == TOK_COPY || t->type == TOK_FILL) return parse_builtin3(NODE_MEMOP);
+    if (t->type >= TOK_READV && t->type <= TOK_COPY_FILE) return parse_builtin3(NODE_XFER);
+    if (t->type >= TOK_SUBMIT_READ && t->type <= TOK_WAIT_COMPLETIONS) return parse_io();
+
     // ── struct Name ... end ──
     if (t->type == TOK_STRUCT) {
         advance();
@@ -247,17 +350,20 @@ static Node *parse_statement() {
         return n;
     }
 
-    // write(fd, buf, size)
+    // write(fd, buf, size) or write(fd, s) — a str carries its own length
     if (t->type == TOK_WRITE) {
         advance();
         expect(TOK_LPAREN, "(");
         Node *n = new_node(NODE_WRITE);
         n->children[0] = parse_expression();   // fd
         expect(TOK_COMMA, ",");
-        n->children[1] = parse_expression();   // buf
-        expect(TOK_COMMA, ",");
-        n->children[2] = parse_expression();   // size
-        n->child_count = 3;
+        n->children[1] = parse_expression();   // buf / str
+        n->child_count = 2;
+        if (peek()->type == TOK_COMMA) {
+            advance();
+            n->children[2] = parse_expression();   // size
+            n->child_count = 3;
+        }
         expect(TOK_RPAREN, ")");
         return n;
     }
@@ -361,7 +467,7 @@ static Node *parse_statement() {
             }
             n->dtype = declared;
         } else {
-            n->dtype = (inferred != DTYPE_UNKNOWN) ? inferred : DTYPE_INT;
+            n->dtype = inferred;    // UNKNOWN — codegen picks the variable's type
         }
 
         // for struct assignments, carry the struct type name in sval
@@ -401,6 +507,37 @@ static Node *parse_statement() {
         return n;
     }
 
+// unmap(s) — munmap a map_file result
+    if (t->type == TOK_UNMAP) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_UNMAP);
+        n->left = parse_expression();    // mapped str
+        expect(TOK_RPAREN, ")");
+        return n;
+    }
+
+// prefetch(ptr, index [, hint]) — hint 0..3 = t0, t1, t2, nta (default t0)
+    if (t->type == TOK_PREFETCH) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_PREFETCH);
+        n->left  = parse_expression();   // ptr
+        expect(TOK_COMMA, ",");
+        n->right = parse_expression();   // element index, like ptr[i]
+        if (peek()->type == TOK_COMMA) {
+            advance();
+            Token *hint = expect(TOK_NUMBER, "prefetch hint");
+            n->ival = atoi(hint->value);
+            if (n->ival < 0 || n->ival > 3) {
+                fprintf(stderr, "Parse error: prefetch hint must be 0-3, got %d\n", n->ival);
+                exit(1);
+            }
+        }
+        expect(TOK_RPAREN, ")");
+        return n;
+    }
+
 
     // ── return expr ──
     if (t->type == TOK_RETURN) {
@@ -433,12 +570,12 @@ static Node *parse_statement() {
     if (t->type == TOK_IF) {
         advance();
         Node *n  = new_node(NODE_IF);
-        n->left  = parse_comparison();
+        n->left  = parse_branch_cond(&n->hint);
         n->right = parse_block_body();
         while (peek()->type == TOK_ELIF) {
             advance();
             Node *elif_node  = new_node(NODE_ELIF);
-            elif_node->left  = parse_comparison();
+            elif_node->left  = parse_branch_cond(&elif_node->hint);
             elif_node->right = parse_block_body();
             n->children[n->child_count++] = elif_node;
         }
@@ -461,7 +598,7 @@ static Node *parse_statement() {
         return n;
     }
 
-    // ── for i = start to limit [step n] ... end ──
+    // ── for i = start to limit [step n] [unroll n] ... end ──
     if (t->type == TOK_FOR) {
         advance();
         Node *n    = new_node(NODE_FOR);
@@ -482,6 +619,16 @@ static Node *parse_statement() {
             n->children[2] = one;
         }
         n->child_count = 3;
+        // optional unroll factor: for i = 0 to n unroll 4
+        if (peek()->type == TOK_UNROLL) {
+            advance();
+            Token *f  = expect(TOK_NUMBER, "unroll factor");
+            n->unroll = atoi(f->value);
+            if (n->unroll < 1) {
+                fprintf(stderr, "Parse error: unroll factor must be at least 1\n");
+                exit(1);
+            }
+        }
         // optional if condition: for i = 0 to 100 if i % 2 == 0
         if (peek()->type == TOK_WHERE) {
             advance();
@@ -490,6 +637,7 @@ static Node *parse_statement() {
             fi->children[1] = n->children[1];
             fi->children[2] = n->children[2];
             strncpy(fi->name, n->name, 63);
+            fi->unroll = n->unroll;
             fi->left = parse_comparison();
             fi->children[3] = parse_block();
             fi->child_count = 4;
@@ -642,9 +790,69 @@ static Node *parse_comparison() {
 }
 
 // ─────────────────────────────────────────
-// Expression: term ((+ -) term)*
+// Expression: bitxor (| bitxor)*
+// bitwise operators bind looser than arithmetic but tighter than
+// comparisons, so `x & mask == 0` tests the masked value
 // ─────────────────────────────────────────
 static Node *parse_expression() {
+    Node *left = parse_bitxor();
+    while (peek()->type == TOK_PIPE) {
+        Token *op = advance();
+        Node  *n  = new_node(NODE_BINOP);
+        strncpy(n->op, op->value, 2);
+        n->left  = left;
+        n->right = parse_bitxor();
+        left     = n;
+    }
+    return left;
+}
+
+// bitxor: bitand (^ bitand)*
+static Node *parse_bitxor() {
+    Node *left = parse_bitand();
+    while (peek()->type == TOK_CARET) {
+        Token *op = advance();
+        Node  *n  = new_node(NODE_BINOP);
+        strncpy(n->op, op->value, 2);
+        n->left  = left;
+        n->right = parse_bitand();
+        left     = n;
+    }
+    return left;
+}
+
+// bitand: shift (& shift)*
+static Node *parse_bitand() {
+    Node *left = parse_shift();
+    while (peek()->type == TOK_AMP) {
+        Token *op = advance();
+        Node  *n  = new_node(NODE_BINOP);
+        strncpy(n->op, op->value, 2);
+        n->left  = left;
+        n->right = parse_shift();
+        left     = n;
+    }
+    return left;
+}
+
+// shift: additive ((<< >>) additive)*
+static Node *parse_shift() {
+    Node *left = parse_additive();
+    while (peek()->type == TOK_SHL || peek()->type == TOK_SHR) {
+        Token *op = advance();
+        Node  *n  = new_node(NODE_BINOP);
+        strncpy(n->op, op->value, 2);
+        n->left  = left;
+        n->right = parse_additive();
+        left     = n;
+    }
+    return left;
+}
+
+// ─────────────────────────────────────────
+// Additive: term ((+ -) term)*
+// ─────────────────────────────────────────
+static Node *parse_additive() {
     Node *left = parse_term();
     while (peek()->type == TOK_PLUS || peek()->type == TOK_MINUS) {
         Token *op = advance();
@@ -705,6 +913,20 @@ static Node *parse_factor() {
         n->dtype = DTYPE_INT;
         return n;
     }
+// map_file(path [, advice]) — returns the file's bytes as a str, no copy
+    if (t->type == TOK_MAP_FILE) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_MAP_FILE);
+        n->left = parse_expression();    // path
+        if (peek()->type == TOK_COMMA) {
+            advance();
+            n->right = parse_expression();   // madvise advice
+        }
+        expect(TOK_RPAREN, ")");
+        n->dtype = DTYPE_STR;
+        return n;
+    }
 // addr(x) — take address of variable
     if (t->type == TOK_ADDR) {
         advance();
@@ -751,6 +973,13 @@ static Node *parse_factor() {
             n->dtype = DTYPE_INT;
             return n;
         }
+        if (num->type == TOK_FLOAT) {
+            advance();
+            Node *n  = new_node(NODE_FLOAT);
+            n->fval  = -strtod(num->value, NULL);
+            n->dtype = DTYPE_FLOAT;
+            return n;
+        }
         // negative expression: -(expr)
         Node *n   = new_node(NODE_NEG);
         n->right  = parse_factor();
@@ -758,6 +987,74 @@ static Node *parse_factor() {
         return n;
     }
 
+    // ~x — bitwise not
+    if (t->type == TOK_TILDE) {
+        advance();
+        Node *n  = new_node(NODE_BITNOT);
+        n->right = parse_factor();
+        n->dtype = DTYPE_INT;
+        return n;
+    }
+
+    // popcnt lzcnt tzcnt bswap abs sqrt take one argument, min / max two
+    // (the TOK_POPCNT..TOK_SQRT block in main.h is kept contiguous)
+    if (t->type >= TOK_POPCNT && t->type <= TOK_SQRT) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_INTRINSIC);
+        n->ival = t->type;
+        strncpy(n->name, t->value, 63);
+        n->children[n->child_count++] = parse_expression();
+        if (t->type == TOK_MIN || t->type == TOK_MAX) {
+            expect(TOK_COMMA, ",");
+            n->children[n->child_count++] = parse_expression();
+        }
+        expect(TOK_RPAREN, ")");
+        if      (t->type == TOK_SQRT) n->dtype = DTYPE_FLOAT;
+        else if (t->type == TOK_MIN || t->type == TOK_MAX || t->type == TOK_ABS)
+            n->dtype = DTYPE_UNKNOWN;       // follows the arguments
+        else    n->dtype = DTYPE_INT;
+        return n;
+    }
+
+    // find(s, t), find_byte(s, b), count_byte(s, b) take two arguments,
+    // split_lines(s, ends, max) three — all scan s with SIMD runtime helpers
+    if (t->type >= TOK_FIND && t->type <= TOK_SPLIT_LINES) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_SCAN);
+        n->ival = t->type;
+        strncpy(n->name, t->value, 63);
+        n->children[n->child_count++] = parse_expression();
+        expect(TOK_COMMA, ",");
+        n->children[n->child_count++] = parse_expression();
+        if (t->type == TOK_SPLIT_LINES) {
+            expect(TOK_COMMA, ",");
+            n->children[n->child_count++] = parse_expression();
+        }
+        expect(TOK_RPAREN, ")");
+        n->dtype = DTYPE_INT;
+        return n;
+    }
+
+    if (t->type == TOK_COMPARE) return parse_builtin3(NODE_MEMOP);
+    if (t->type >= TOK_READV && t->type <= TOK_COPY_FILE) return parse_builtin3(NODE_XFER);
+    if (t->type >= TOK_SUBMIT_READ && t->type <= TOK_WAIT_COMPLETIONS) return parse_io();
+
+    // select(cond, a, b) — a if cond else b, without a branch
+    if (t->type == TOK_SELECT) {
+        advance();
+        expect(TOK_LPAREN, "(");
+        Node *n = new_node(NODE_SELECT);
+        n->children[n->child_count++] = parse_comparison();
+        expect(TOK_COMMA, ",");
+        n->children[n->child_count++] = parse_expression();
+        expect(TOK_COMMA, ",");
+        n->children[n->child_count++] = parse_expression();
+        expect(TOK_RPAREN, ")");
+        return n;
+    }
+
     if (t->type == TOK_STRLEN) {
         advance();
         expect(TOK_LPAREN, "(");
@@ -776,6 +1073,25 @@ static Node *parse_factor() {
         return n;
     }
 
+    if (t->type == TOK_FLOAT) {
+        advance();
+        Node *n  = new_node(NODE_FLOAT);
+        n->fval  = strtod(t->value, NULL);
+        n->dtype = DTYPE_FLOAT;
+        return n;
+    }
+
+    // int(x) / float(x) — conversion
+    if ((t->type == TOK_TINT || t->type == TOK_TFLOAT) && peek2()->type == TOK_LPAREN) {
+        advance();
+        advance();
+        Node *n  = new_node(NODE_CAST);
+        n->dtype = (t->type == TOK_TINT) ? DTYPE_INT : DTYPE_FLOAT;
+        n->right = parse_expression();
+        expect(TOK_RPAREN, ")");
+        return n;
+    }
+
     if (t->type == TOK_TRUE || t->type == TOK_FALSE) {
         advance();
         Node *n  = new_node(NODE_BOOL);
@@ -787,7 +1103,12 @@ static Node *parse_factor() {
     if (t->type == TOK_STRING) {
         advance();
         Node *n = new_node(NODE_STRING);
-        strncpy(n->sval, t->value, 255);
+        if (t->len > 255) {
+            fprintf(stderr, "Parse error: string literal longer than 255 bytes\n");
+            exit(1);
+        }
+        memcpy(n->sval, t->start, t->len);      // the token's value stops at 63
+        n->sval[t->len] = 0;
         n->dtype = DTYPE_STR;
         return n;
     }
@@ -827,9 +1148,28 @@ static Node *parse_factor() {
         // array access: nums[i]
         if (peek()->type == TOK_LBRACKET) {
             advance();
+            Node *index = peek()->type == TOK_COLON ? NULL : parse_expression();
+            if (peek()->type == TOK_COLON) {
+                // slice: s[a:b], s[a:], s[:b] — a view, nothing is copied
+                advance();
+                Node *n  = new_node(NODE_SLICE);
+                strncpy(n->name, name, 63);
+                n->left  = new_node(NODE_IDENT);
+                strncpy(n->left->name, name, 63);
+                if (!index) {
+                    index = new_node(NODE_NUMBER);
+                    index->dtype = DTYPE_INT;
+                }
+                n->children[n->child_count++] = index;
+                if (peek()->type != TOK_RBRACKET)
+                    n->children[n->child_count++] = parse_expression();
+                expect(TOK_RBRACKET, "]");
+                n->dtype = DTYPE_STR;
+                return n;
+            }
             Node *n = new_node(NODE_ARRAY_ACCESS);
             strncpy(n->name, name, 63);
-            n->left = parse_expression();
+            n->left = index;
             expect(TOK_RBRACKET, "]");
             return n;
         }